@@ -0,0 +1,2 @@
+call build.bat
+main.exe
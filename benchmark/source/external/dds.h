@@ -0,0 +1,324 @@
+//**************************************************
+// DDS and KTX - block compressed texture containers
+// parses BC1/BC2/BC3/BC7 (dds) and ETC1/ETC2/BC (ktx) mip chains
+// ready for glCompressedTexImage2D, and decompresses BC1/BC2/BC3 to RGBA
+// for drivers without s3tc
+//**************************************************
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <string.h>
+
+#define DDS_MAX_LEVELS 16
+
+// gl compressed formats
+#define DDS_BC1 0x83F1 // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define DDS_BC2 0x83F2 // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#define DDS_BC3 0x83F3 // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define DDS_BC7 0x8E8C // GL_COMPRESSED_RGBA_BPTC_UNORM
+#define DDS_ETC1 0x8D64 // GL_ETC1_RGB8_OES
+#define DDS_ETC2_RGB 0x9274 // GL_COMPRESSED_RGB8_ETC2
+#define DDS_ETC2_RGB_A1 0x9276 // GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2
+#define DDS_ETC2_RGBA 0x9278 // GL_COMPRESSED_RGBA8_ETC2_EAC
+
+typedef struct BlockImage
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int levels;
+	unsigned int format; // DDS_BC1...
+	unsigned int block_bytes; // 8 or 16 per 4x4 block
+	const unsigned char* level_data[DDS_MAX_LEVELS];
+	long level_size[DDS_MAX_LEVELS];
+} BlockImage;
+
+unsigned int dds_read_32(const unsigned char* bytes)
+{
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24;
+}
+
+unsigned int dds_block_bytes(const unsigned int format)
+{
+	switch (format)
+	{
+	case DDS_BC1:
+	case DDS_ETC1:
+	case DDS_ETC2_RGB:
+	case DDS_ETC2_RGB_A1:
+		return 8;
+
+	case DDS_BC2:
+	case DDS_BC3:
+	case DDS_BC7:
+	case DDS_ETC2_RGBA:
+		return 16;
+	}
+
+	return 0;
+}
+
+long dds_level_size(const unsigned int width, const unsigned int height, const unsigned int block_bytes)
+{
+	long blocks_x = width > 4 ? (width + 3) / 4 : 1;
+	long blocks_y = height > 4 ? (height + 3) / 4 : 1;
+
+	return blocks_x * blocks_y * block_bytes;
+}
+
+// fills every level pointer from packed levels at data - returns 0 when data is too short
+int dds_split_levels(BlockImage* image, const unsigned char* data, long size)
+{
+	unsigned int width = image->width;
+	unsigned int height = image->height;
+
+	for (unsigned int i = 0; i < image->levels; i++)
+	{
+		long level_size = dds_level_size(width, height, image->block_bytes);
+
+		if (level_size > size)
+			return 0;
+
+		image->level_data[i] = data;
+		image->level_size[i] = level_size;
+
+		data += level_size;
+		size -= level_size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return 1;
+}
+
+int dds_parse(const void* data, const long size, BlockImage* image)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	if (size < 128 || memcmp(bytes, "DDS ", 4) != 0)
+		return 0;
+
+	const unsigned char* header = bytes + 4;
+	long offset = 128;
+
+	image->height = dds_read_32(header + 8);
+	image->width = dds_read_32(header + 12);
+	image->levels = dds_read_32(header + 24);
+	image->format = 0;
+
+	if (image->levels == 0)
+		image->levels = 1;
+
+	if (image->levels > DDS_MAX_LEVELS)
+		image->levels = DDS_MAX_LEVELS;
+
+	const unsigned char* four_cc = header + 80;
+
+	if (memcmp(four_cc, "DXT1", 4) == 0)
+		image->format = DDS_BC1;
+	else if (memcmp(four_cc, "DXT3", 4) == 0)
+		image->format = DDS_BC2;
+	else if (memcmp(four_cc, "DXT5", 4) == 0)
+		image->format = DDS_BC3;
+	else if (memcmp(four_cc, "DX10", 4) == 0 && size >= 148)
+	{
+		unsigned int dxgi_format = dds_read_32(bytes + 128);
+		offset = 148;
+
+		switch (dxgi_format)
+		{
+		case 71: case 72: image->format = DDS_BC1; break;
+		case 74: case 75: image->format = DDS_BC2; break;
+		case 77: case 78: image->format = DDS_BC3; break;
+		case 98: case 99: image->format = DDS_BC7; break;
+		}
+	}
+
+	image->block_bytes = dds_block_bytes(image->format);
+
+	if (image->block_bytes == 0 || image->width == 0 || image->height == 0)
+		return 0;
+
+	return dds_split_levels(image, bytes + offset, size - offset);
+}
+
+int ktx_parse(const void* data, const long size, BlockImage* image)
+{
+	static const unsigned char identifier[12] =
+		{ 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	if (size < 64 || memcmp(bytes, identifier, 12) != 0 || dds_read_32(bytes + 12) != 0x04030201)
+		return 0;
+
+	image->format = dds_read_32(bytes + 28);
+	image->width = dds_read_32(bytes + 36);
+	image->height = dds_read_32(bytes + 40);
+	image->levels = dds_read_32(bytes + 56);
+	image->block_bytes = dds_block_bytes(image->format);
+
+	if (image->levels == 0)
+		image->levels = 1;
+
+	if (image->levels > DDS_MAX_LEVELS)
+		image->levels = DDS_MAX_LEVELS;
+
+	if (image->block_bytes == 0 || image->width == 0 || image->height == 0 ||
+		dds_read_32(bytes + 44) > 1 || dds_read_32(bytes + 48) > 1 || dds_read_32(bytes + 52) > 1)
+		return 0; // only plain 2d textures
+
+	long offset = 64 + dds_read_32(bytes + 60);
+	unsigned int width = image->width;
+	unsigned int height = image->height;
+
+	// every level is prefixed with its size
+	for (unsigned int i = 0; i < image->levels; i++)
+	{
+		if (offset + 4 > size)
+			return 0;
+
+		long level_size = dds_read_32(bytes + offset);
+		offset += 4;
+
+		if (offset + level_size > size || level_size < dds_level_size(width, height, image->block_bytes))
+			return 0;
+
+		image->level_data[i] = bytes + offset;
+		image->level_size[i] = level_size;
+
+		offset += (level_size + 3) & ~3;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return 1;
+}
+
+void dds_color_565(const unsigned int color, unsigned char* rgba)
+{
+	rgba[0] = ((color >> 11) & 31) * 255 / 31;
+	rgba[1] = ((color >> 5) & 63) * 255 / 63;
+	rgba[2] = (color & 31) * 255 / 31;
+	rgba[3] = 255;
+}
+
+// 4x4 color block into 16 RGBA pixels - four_colors is always on for BC2/BC3
+void dds_decode_color(const unsigned char* block, unsigned char* pixels, const int four_colors)
+{
+	unsigned char palette[4][4];
+	unsigned int c0 = block[0] | block[1] << 8;
+	unsigned int c1 = block[2] | block[3] << 8;
+
+	dds_color_565(c0, palette[0]);
+	dds_color_565(c1, palette[1]);
+
+	for (int c = 0; c < 3; c++)
+	{
+		if (c0 > c1 || four_colors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	palette[2][3] = 255;
+	palette[3][3] = c0 > c1 || four_colors ? 255 : 0;
+
+	unsigned int indices = dds_read_32(block + 4);
+
+	for (int i = 0; i < 16; i++)
+		memcpy(pixels + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+}
+
+void dds_decode_alpha_bc2(const unsigned char* block, unsigned char* pixels)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		int value = (block[i / 2] >> ((i & 1) * 4)) & 15;
+		pixels[i * 4 + 3] = value * 17;
+	}
+}
+
+void dds_decode_alpha_bc3(const unsigned char* block, unsigned char* pixels)
+{
+	unsigned char palette[8];
+	int a0 = block[0];
+	int a1 = block[1];
+
+	palette[0] = a0;
+	palette[1] = a1;
+
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	unsigned long long indices = 0;
+
+	for (int i = 0; i < 6; i++)
+		indices |= (unsigned long long)block[2 + i] << (i * 8);
+
+	for (int i = 0; i < 16; i++)
+		pixels[i * 4 + 3] = palette[(indices >> (i * 3)) & 7];
+}
+
+int dds_can_decompress(const unsigned int format)
+{
+	return format == DDS_BC1 || format == DDS_BC2 || format == DDS_BC3;
+}
+
+// decompresses one level into width x height RGBA pixels - returns 0 for unsupported formats
+int dds_decompress(const BlockImage* image, const unsigned int level, unsigned char* rgba)
+{
+	if (! dds_can_decompress(image->format) || level >= image->levels)
+		return 0;
+
+	unsigned int width = image->width >> level;
+	unsigned int height = image->height >> level;
+	width = width > 0 ? width : 1;
+	height = height > 0 ? height : 1;
+
+	const unsigned char* block = image->level_data[level];
+	unsigned char pixels[16 * 4];
+
+	for (unsigned int by = 0; by < height; by += 4)
+	{
+		for (unsigned int bx = 0; bx < width; bx += 4, block += image->block_bytes)
+		{
+			if (image->format == DDS_BC1)
+				dds_decode_color(block, pixels, 0);
+			else
+			{
+				dds_decode_color(block + 8, pixels, 1);
+
+				if (image->format == DDS_BC2)
+					dds_decode_alpha_bc2(block, pixels);
+				else
+					dds_decode_alpha_bc3(block, pixels);
+			}
+
+			for (unsigned int y = 0; y < 4 && by + y < height; y++)
+				for (unsigned int x = 0; x < 4 && bx + x < width; x++)
+					memcpy(rgba + ((by + y) * width + bx + x) * 4, pixels + (y * 4 + x) * 4, 4);
+		}
+	}
+
+	return 1;
+}
+
+#endif
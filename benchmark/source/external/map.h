@@ -0,0 +1,44 @@
+//**************************************************
+// MAP - Proto tilemap file
+// header followed by every layer - a MapLayer and its columns x rows tiles
+// written by tools map from Tiled maps, loaded by load_chunk_map
+//**************************************************
+
+#ifndef MAP_H
+#define MAP_H
+
+#define MAP_MAGIC 0x50414D50 // PMAP
+#define MAP_VERSION 1
+#define MAP_NAME_LENGTH 32
+#define MAP_ATLAS_LENGTH 64
+#define MAP_MAX_LAYERS 8
+
+typedef struct MapHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int columns; // map size in tiles
+	unsigned int rows;
+	unsigned int tile_width; // atlas pixels
+	unsigned int tile_height;
+	unsigned int layers; // drawn first to last
+	char atlas[MAP_ATLAS_LENGTH]; // image path from the game build folder
+} MapHeader;
+
+// followed by columns x rows unsigned shorts - row after row
+// 0 is empty - n is atlas tile n - 1 counting left to right
+typedef struct MapLayer
+{
+	char name[MAP_NAME_LENGTH];
+	unsigned int opacity; // 0 - 255
+	unsigned int visible;
+} MapLayer;
+
+// bytes of a file with this header
+long map_size(const MapHeader* header)
+{
+	return sizeof(MapHeader) +
+		header->layers * (sizeof(MapLayer) + (long)header->columns * header->rows * sizeof(unsigned short));
+}
+
+#endif
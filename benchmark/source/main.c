@@ -0,0 +1,755 @@
+#include "external/engine.h"
+
+// engine benchmarks - every scene runs WARMUP_FRAMES and then averages
+// frame_stats over MEASURED_FRAMES - results go to benchmark.txt
+
+#define WARMUP_FRAMES 60
+#define MEASURED_FRAMES 300
+#define OVERDRAW_FRAMES 10 // after the measured ones - the heatmap reads the screen back so they aren't timed
+
+#define TILE_COUNT 10
+#define MIXED_SPRITES 20000
+#define BOARD_COLUMNS 38
+#define BOARD_ROWS 21
+#define BOARD_TILES (BOARD_COLUMNS * BOARD_ROWS)
+#define MAP_SIZE 1000
+#define MAP_EDITS 100
+#define ANIMATED_SPRITES 100000
+#define ANIMATED_DRAWN 2000 // the rest only update
+#define TWEENED_SPRITES 12500 // 4 tweens each
+#define PARTICLE_CAPACITY 262144
+#define MILLION_CAPACITY 1048576
+#define EMITTER_COUNT 8 // 12500 particles a second each - about 200000 alive
+#define EMITTER_RATE 12500
+#define MILLION_RATE 62500 // about 1000000 alive
+#define ENTITY_COUNT 100000
+#define BULLET_COUNT 4000 // alive at once - living 1 to 20 frames
+
+typedef struct Scene
+{
+	const char* name;
+	void (*init)();
+	void (*tick)();
+} Scene;
+
+// the array of structs the entity scenes compare against
+typedef struct Actor
+{
+	Vector position;
+	Vector velocity;
+	Sprite sprite;
+	int health;
+} Actor;
+
+typedef struct Bullet
+{
+	Sprite sprite;
+	Vector velocity;
+	int life; // frames
+} Bullet;
+
+typedef struct Totals
+{
+	double tick_ms;
+	double update_ms;
+	double present_ms;
+	double gpu_ms;
+	double draw_calls;
+	double texture_binds;
+	double vertices;
+	double allocations;
+	double overdraw_average;
+	uint overdraw_max;
+} Totals;
+
+TextureHandle tiles[TILE_COUNT];
+TextureHandle tile_layers[TILE_COUNT]; // same images on a texture array
+int tile_layer_count;
+Sprite mixed[MIXED_SPRITES];
+Sprite board[BOARD_TILES];
+Sprite board_layers[BOARD_TILES];
+Tilemap map;
+ChunkMap chunk_map;
+double chunk_build_ms[2]; // main thread only and with workers
+TextureHandle sheet;
+Animations animations;
+Sprite animated[ANIMATED_SPRITES];
+Sprite tweened[TWEENED_SPRITES];
+Particles particles;
+Particles million; // the cpu side of the compute comparison
+GpuParticles gpu_particles;
+Actor actors[ENTITY_COUNT];
+int position_component;
+int velocity_component;
+int sprite_component;
+int health_component;
+Pool bullets;
+Bullet* loose_bullets[BULLET_COUNT]; // the malloc scene
+int loose_bullet_count;
+Emitter emitters[EMITTER_COUNT];
+double update_ms; // bulk update timed by the scene - 0 for none
+
+//**************************************************
+// SCENES
+//**************************************************
+
+// sprites from 10 textures in random order - the worst case for batching
+void draw_mixed()
+{
+	draw_sprites(mixed, MIXED_SPRITES);
+}
+
+// a board of 50 pixel tiles - random image per cell
+void draw_board()
+{
+	draw_sprites(board, BOARD_TILES);
+}
+
+// same board from the texture array - separate textures without support
+void draw_board_layers()
+{
+	draw_sprites(tile_layer_count > 0 ? board_layers : board, BOARD_TILES);
+}
+
+// 1000x1000 tiles scrolling - one quad whatever the map size
+void draw_map()
+{
+	map.position.x = -(frame_number % 1000) * 10.f;
+	map.position.y = -(frame_number % 1000) * 5.f;
+
+	draw_tilemap(&map);
+}
+
+// a 10x10 area changing every frame
+void draw_edited_map()
+{
+	int x = rand() % (MAP_SIZE - 10);
+	int y = rand() % (MAP_SIZE - 10);
+
+	for (int i = 0; i < MAP_EDITS; i++)
+		set_tile(&map, x + i % 10, y + i / 10, 1 + rand() % TILE_COUNT);
+
+	draw_map();
+}
+
+// same map as 16x16 tile chunks plus a sparse second layer - a draw per chunk on screen
+void draw_chunks()
+{
+	chunk_map.position.x = -(frame_number % 1000) * 10.f;
+	chunk_map.position.y = -(frame_number % 1000) * 5.f;
+
+	draw_chunk_map(&chunk_map);
+}
+
+// the 10x10 area touches up to 4 chunks - rebuilt when drawn
+void draw_edited_chunks()
+{
+	int x = rand() % (MAP_SIZE - 10);
+	int y = rand() % (MAP_SIZE - 10);
+
+	for (int i = 0; i < MAP_EDITS; i++)
+		set_map_tile(&chunk_map, 0, x + i % 10, y + i / 10, 1 + rand() % TILE_COUNT);
+
+	draw_chunks();
+}
+
+// 100000 players on loop, ping pong and once clips of the tileset
+void animate()
+{
+	double start = now_ms();
+
+	update_animations(&animations, animated, 1.f);
+	update_ms = now_ms() - start;
+
+	// once clips raise an event on their last frame - play them again
+	for (int i = 0; i < animation_event_count; i++)
+		play_animation(&animations, animation_events[i].player, animation_events[i].clip, &animated[animation_events[i].player]);
+
+	draw_sprites(animated, ANIMATED_DRAWN);
+}
+
+// 50000 tweens on position, scale, rotation and alpha repeating back and forth
+void start_tweens()
+{
+	for (int i = 0; i < TWEENED_SPRITES; i++)
+	{
+		Sprite* sprite = &tweened[i];
+		byte ease = rand() % EASE_COUNT;
+
+		*sprite = sprite_from_handle(tiles[i % TILE_COUNT]);
+		sprite->position.x = rand() % DISPLAY_WIDTH;
+		sprite->position.y = rand() % DISPLAY_HEIGHT;
+		sprite->scale = 0.1f;
+		sprite->pivot_x = 100;
+		sprite->pivot_y = 100;
+
+		set_tween_repeat(tween(&sprite->position.y, sprite->position.y + 100, 400 + rand() % 800, ease), -1, true);
+		set_tween_repeat(tween(&sprite->scale, 0.3f, 300 + rand() % 600, ease), -1, true);
+		set_tween_repeat(tween(&sprite->rotation, 360, 1000 + rand() % 2000, EASE_LINEAR), -1, false);
+		set_tween_repeat(tween_byte(&sprite->color.a, 0, 500 + rand() % 500, ease), -1, true);
+	}
+
+	TEXTURE_SLOTS = 16;
+}
+
+void draw_tweens()
+{
+	double start = now_ms();
+
+	update_tweens(1.f);
+	update_ms = now_ms() - start;
+
+	draw_sprites(tweened, ANIMATED_DRAWN);
+}
+
+void set_emitter_rates(const float rate)
+{
+	for (int i = 0; i < EMITTER_COUNT; i++)
+	{
+		emitters[i].rate = rate;
+		emitters[i].owed = 0;
+	}
+}
+
+void update_fountains(Particles* target)
+{
+	for (int i = 0; i < EMITTER_COUNT; i++)
+		update_emitter(target, &emitters[i], 1.f);
+
+	update_particles(target, 1.f);
+}
+
+// 8 fountains of 2 second particles under gravity - about 200000 alive
+void start_fountains()
+{
+	TEXTURE_SLOTS = 1;
+	set_emitter_rates(EMITTER_RATE);
+
+	// 2 seconds ahead so the warmup starts full
+	for (int i = 0; i < 120; i++)
+		update_fountains(&particles);
+}
+
+void fountains()
+{
+	double start = now_ms();
+
+	update_fountains(&particles);
+	update_ms = now_ms() - start;
+
+	draw_particles(&particles);
+}
+
+// the same fountains at 5 times the rate - about 1000000 alive
+void start_million_fountains()
+{
+	TEXTURE_SLOTS = 1;
+	set_emitter_rates(MILLION_RATE);
+
+	for (int i = 0; i < 120; i++)
+		update_fountains(&million);
+}
+
+void million_fountains()
+{
+	double start = now_ms();
+
+	update_fountains(&million);
+	update_ms = now_ms() - start;
+
+	draw_particles(&million);
+}
+
+// the million on the compute shader - update ms is only issuing the dispatch
+void start_gpu_fountains()
+{
+	TEXTURE_SLOTS = 1;
+	set_emitter_rates(MILLION_RATE);
+
+	for (int i = 0; i < 120; i++)
+		update_gpu_particles(&gpu_particles, emitters, EMITTER_COUNT, 1.f);
+}
+
+void gpu_fountains()
+{
+	double start = now_ms();
+
+	update_gpu_particles(&gpu_particles, emitters, EMITTER_COUNT, 1.f);
+	update_ms = now_ms() - start;
+
+	draw_gpu_particles(&gpu_particles);
+}
+
+// position += velocity on 100000 entities of 3 archetypes - the query
+// walks only the 2 columns
+void move_entities()
+{
+	double start = now_ms();
+	Query moving = query(MASK(position_component) | MASK(velocity_component), 0);
+
+	for (Archetype* table; (table = next_archetype(&moving)) != NULL;)
+	{
+		Vector* position = (Vector*)column(table, position_component);
+		Vector* velocity = (Vector*)column(table, velocity_component);
+
+		for (int i = 0; i < table->count; i++)
+		{
+			position[i].x += velocity[i].x;
+			position[i].y += velocity[i].y;
+		}
+	}
+
+	update_ms = now_ms() - start;
+}
+
+// the same on 56 byte structs - every cache line also brings the sprite
+void move_actors()
+{
+	double start = now_ms();
+
+	for (int i = 0; i < ENTITY_COUNT; i++)
+	{
+		actors[i].position.x += actors[i].velocity.x;
+		actors[i].position.y += actors[i].velocity.y;
+	}
+
+	update_ms = now_ms() - start;
+}
+
+void spawn_bullet(Bullet* bullet)
+{
+	bullet->sprite = sprite_from_handle(tiles[rand() % TILE_COUNT]);
+	bullet->sprite.position.x = DISPLAY_WIDTH / 2;
+	bullet->sprite.position.y = DISPLAY_HEIGHT / 2;
+	bullet->sprite.scale = 0.05f;
+	bullet->velocity.x = rand() % 41 - 20;
+	bullet->velocity.y = rand() % 41 - 20;
+	bullet->life = 1 + rand() % 20;
+}
+
+void move_bullet(Bullet* bullet)
+{
+	bullet->sprite.position.x += bullet->velocity.x;
+	bullet->sprite.position.y += bullet->velocity.y;
+	bullet->life--;
+}
+
+// about 400 bullets die and spawn every frame - from a pool, no heap
+void pooled_bullets()
+{
+	double start = now_ms();
+	Bullet* bullet;
+
+	POOL_EACH(&bullets, Bullet, bullet)
+	{
+		move_bullet(bullet);
+
+		if (bullet->life <= 0)
+			pool_free(&bullets, bullet);
+	}
+
+	while (bullets.count < BULLET_COUNT)
+		spawn_bullet(POOL_ALLOC(&bullets, Bullet));
+
+	update_ms = now_ms() - start;
+
+	POOL_EACH(&bullets, Bullet, bullet)
+		draw_sprite(&bullet->sprite);
+}
+
+// the same with a malloc and free per bullet
+void malloc_bullets()
+{
+	double start = now_ms();
+
+	for (int i = loose_bullet_count - 1; i >= 0; i--)
+	{
+		move_bullet(loose_bullets[i]);
+
+		if (loose_bullets[i]->life <= 0)
+		{
+			free(loose_bullets[i]);
+			loose_bullets[i] = loose_bullets[--loose_bullet_count];
+		}
+	}
+
+	while (loose_bullet_count < BULLET_COUNT)
+	{
+		Bullet* bullet = (Bullet*)counted_malloc(sizeof(Bullet));
+
+		spawn_bullet(bullet);
+		loose_bullets[loose_bullet_count++] = bullet;
+	}
+
+	update_ms = now_ms() - start;
+
+	for (int i = 0; i < loose_bullet_count; i++)
+		draw_sprite(&loose_bullets[i]->sprite);
+}
+
+void single_texture_batches()
+{
+	TEXTURE_SLOTS = 1;
+}
+
+void multi_texture_batches()
+{
+	TEXTURE_SLOTS = 16;
+}
+
+Scene scenes[] =
+{
+	{ "mixed tiles - texture per batch", single_texture_batches, draw_mixed },
+	{ "mixed tiles - multi texture batches", multi_texture_batches, draw_mixed },
+	{ "tile board - texture per batch", single_texture_batches, draw_board },
+	{ "tile board - texture array", single_texture_batches, draw_board_layers },
+	{ "tilemap 1000x1000", single_texture_batches, draw_map },
+	{ "tilemap 1000x1000 - 100 edits a frame", single_texture_batches, draw_edited_map },
+	{ "chunk map 1000x1000 - 2 layers", single_texture_batches, draw_chunks },
+	{ "chunk map 1000x1000 - 100 edits a frame", single_texture_batches, draw_edited_chunks },
+	{ "animations - 100000 players", multi_texture_batches, animate },
+	{ "tweens - 50000 on 12500 sprites", start_tweens, draw_tweens },
+	{ "particles - 200000 point sprites", start_fountains, fountains },
+	{ "particles cpu - 1000000 point sprites", start_million_fountains, million_fountains },
+	{ "particles gpu - 1000000 compute shader", start_gpu_fountains, gpu_fountains },
+	{ "entities - 100000 archetype query", single_texture_batches, move_entities },
+	{ "entities - 100000 array of structs", single_texture_batches, move_actors },
+	{ "bullets - 4000 from a pool", multi_texture_batches, pooled_bullets },
+	{ "bullets - 4000 malloc and free", multi_texture_batches, malloc_bullets },
+};
+
+const int SCENE_COUNT = sizeof(scenes) / sizeof(Scene);
+
+//**************************************************
+// RUNNER
+//**************************************************
+
+int current = -1;
+int frame = 0;
+Totals totals[sizeof(scenes) / sizeof(Scene)];
+
+void start_scene(const int index)
+{
+	cancel_all_tweens();
+
+	current = index;
+	frame = 0;
+	update_ms = 0;
+
+	if (current < SCENE_COUNT)
+		scenes[current].init();
+}
+
+// frame_stats has the numbers of the previous frame
+void measure()
+{
+	Totals* total = &totals[current];
+
+	total->tick_ms += frame_stats.tick_ms;
+	total->update_ms += update_ms;
+	total->present_ms += frame_stats.present_ms;
+	total->gpu_ms += frame_stats.gpu_ms[GPU_PASS_GAME];
+	total->draw_calls += frame_stats.draw_calls;
+	total->texture_binds += frame_stats.texture_binds;
+	total->vertices += frame_stats.vertices;
+	total->allocations += frame_stats.allocations;
+}
+
+// the overdraw view is on from the frame after the measured ones
+void measure_overdraw()
+{
+	Totals* total = &totals[current];
+
+	total->overdraw_average += frame_stats.overdraw_average;
+
+	if (frame_stats.overdraw_max > total->overdraw_max)
+		total->overdraw_max = frame_stats.overdraw_max;
+}
+
+void write_results()
+{
+	FILE* file = fopen("benchmark.txt", "w");
+
+	if (file == NULL)
+		return;
+
+	fprintf(file, "%-40s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+		"scene", "tick ms", "update ms", "present ms", "gpu ms", "draws", "binds", "vertices", "allocs",
+		"overdraw", "max");
+
+	for (int i = 0; i < SCENE_COUNT; i++)
+	{
+		Totals total = totals[i];
+
+		fprintf(file, "%-40s %10.2f %10.3f %10.2f %10.2f %10.0f %10.0f %10.0f %10.1f %10.2f %10u\n", scenes[i].name,
+			total.tick_ms / MEASURED_FRAMES, total.update_ms / MEASURED_FRAMES,
+			total.present_ms / MEASURED_FRAMES, total.gpu_ms / MEASURED_FRAMES,
+			total.draw_calls / MEASURED_FRAMES, total.texture_binds / MEASURED_FRAMES, total.vertices / MEASURED_FRAMES,
+			total.allocations / MEASURED_FRAMES, total.overdraw_average / OVERDRAW_FRAMES, total.overdraw_max);
+	}
+
+	if (! gpu_timers)
+		fprintf(file, "\ngpu timer queries not supported - gpu ms is 0\n");
+
+	long separate = 0;
+	long layers = 0;
+
+	for (int i = 0; i < TILE_COUNT; i++)
+	{
+		separate += texture_entry(tiles[i])->bytes;
+
+		if (tile_layer_count > 0)
+			layers += texture_entry(tile_layers[i])->bytes;
+	}
+
+	fprintf(file, "\ntiles as %i textures: %li bytes of VRAM\n", TILE_COUNT, separate);
+
+	if (tile_layer_count > 0)
+		fprintf(file, "tiles as 1 texture array: %li bytes of VRAM\n", layers);
+	else
+		fprintf(file, "texture arrays not supported - the texture array scene drew separate textures\n");
+
+	if (! gpu_particles.compute)
+		fprintf(file, "\ncompute particles not supported - the gpu particle scene ran on the cpu\n");
+
+	fprintf(file, "\nframe arena peak %li of %li bytes, scratch arena peak %li of %li bytes\n",
+		frame_arena.peak, frame_arena.size, scratch_arena.peak, scratch_arena.size);
+
+	PoolStats pool = pool_stats(&bullets);
+
+	fprintf(file, "\nbullet pool: %i of %i live, peak %i, %i refused, %.0f%% fragmented\n",
+		pool.count, pool.capacity, pool.peak, pool.refused, pool.fragmentation * 100.f);
+
+	fprintf(file, "\nchunk map %ix%i with 2 layers built in %.1f ms on the main thread, %.1f ms with %i workers\n",
+		MAP_SIZE, MAP_SIZE, chunk_build_ms[0], chunk_build_ms[1], CHUNK_THREADS);
+
+	fclose(file);
+}
+
+//**************************************************
+// GAME
+//**************************************************
+
+void game_init()
+{
+	srand(7); // same layout every run
+
+	char paths[TILE_COUNT][32];
+	string tile_paths[TILE_COUNT];
+
+	for (int i = 0; i < TILE_COUNT; i++)
+	{
+		sprintf(paths[i], "res/tile%i.png", i + 1);
+		tile_paths[i] = paths[i];
+		tiles[i] = acquire_texture(paths[i]);
+	}
+
+	tile_layer_count = load_texture_array(tile_paths, TILE_COUNT, tile_layers);
+
+	for (int i = 0; i < MIXED_SPRITES; i++)
+	{
+		mixed[i] = sprite_from_handle(tiles[rand() % TILE_COUNT]);
+		mixed[i].position.x = rand() % DISPLAY_WIDTH;
+		mixed[i].position.y = rand() % DISPLAY_HEIGHT;
+		mixed[i].scale = 0.25f;
+		mixed[i].pivot_x = 100;
+		mixed[i].pivot_y = 100;
+		mixed[i].rotation = rand() % 360;
+	}
+
+	for (int i = 0; i < BOARD_TILES; i++)
+	{
+		int tile = rand() % TILE_COUNT;
+
+		board[i] = sprite_from_handle(tiles[tile]);
+		board[i].position.x = i % BOARD_COLUMNS * 50;
+		board[i].position.y = i / BOARD_COLUMNS * 50;
+		board[i].scale = 0.25f;
+
+		board_layers[i] = board[i];
+		board_layers[i].image = tile_layers[tile];
+	}
+
+	map = load_tilemap("res/tileset.png", 200, 200, MAP_SIZE, MAP_SIZE);
+	map.scale = 0.25f;
+
+	for (int y = 0; y < MAP_SIZE; y++)
+		for (int x = 0; x < MAP_SIZE; x++)
+			set_tile(&map, x, y, 1 + rand() % TILE_COUNT);
+
+	chunk_map = create_chunk_map("res/tileset.png", 200, 200, MAP_SIZE, MAP_SIZE, 2);
+	chunk_map.scale = 0.25f;
+
+	for (int y = 0; y < MAP_SIZE; y++)
+		for (int x = 0; x < MAP_SIZE; x++)
+		{
+			set_map_tile(&chunk_map, 0, x, y, get_tile(&map, x, y));
+
+			if (rand() % 8 == 0)
+				set_map_tile(&chunk_map, 1, x, y, 1 + rand() % TILE_COUNT);
+		}
+
+	// the same build twice - the second one with the worker threads
+	int threads = CHUNK_THREADS;
+
+	for (int i = 0; i < 2; i++)
+	{
+		double start = now_ms();
+
+		CHUNK_THREADS = i == 0 ? 0 : threads;
+		build_chunk_map(&chunk_map);
+		chunk_build_ms[i] = now_ms() - start;
+	}
+
+	sheet = acquire_texture("res/tileset.png");
+	animations = create_animations(ANIMATED_SPRITES);
+
+	int loop = add_grid_clip(sheet, 200, 200, 0, TILE_COUNT, 100.f, ANIMATION_LOOP);
+	int ping_pong = add_grid_clip(sheet, 200, 200, 0, TILE_COUNT / 2, 80.f, ANIMATION_PING_PONG);
+	int once = add_grid_clip(sheet, 200, 200, TILE_COUNT / 2, TILE_COUNT / 2, 120.f, ANIMATION_ONCE);
+	int played[] = { loop, ping_pong, once };
+
+	set_clip_event(once, TILE_COUNT / 2 - 1, 1);
+
+	for (int i = 0; i < ANIMATED_SPRITES; i++)
+	{
+		animated[i] = sprite_from_handle(sheet);
+		animated[i].position.x = i % 50 * 38;
+		animated[i].position.y = i / 50 % 40 * 27;
+		animated[i].scale = 0.125f;
+
+		play_animation(&animations, i, played[rand() % 3], &animated[i]);
+		set_animation_speed(&animations, i, 0.5f + (rand() % 100) / 66.f);
+		animations.time[i] = rand() % 100; // out of step
+	}
+
+	particles = create_particles("res/particle.png", PARTICLE_CAPACITY);
+	particles.gravity.y = 200;
+	particles.drag = 0.2f;
+	particles.end_scale = 0.25f;
+
+	million = create_particles("res/particle.png", MILLION_CAPACITY);
+	million.gravity = particles.gravity;
+	million.drag = particles.drag;
+	million.end_scale = particles.end_scale;
+
+	gpu_particles = create_gpu_particles("res/particle.png", MILLION_CAPACITY);
+	gpu_particles.gravity = particles.gravity;
+	gpu_particles.drag = particles.drag;
+	gpu_particles.end_scale = particles.end_scale;
+
+	for (int i = 0; i < EMITTER_COUNT; i++)
+	{
+		Emitter* emitter = &emitters[i];
+
+		memset(emitter, 0, sizeof(Emitter));
+		emitter->position.x = 100 + i * 200;
+		emitter->position.y = 900;
+		emitter->area.x = 20;
+		emitter->velocity.y = -400;
+		emitter->velocity_spread.x = 150;
+		emitter->velocity_spread.y = 100;
+		emitter->life = 2000;
+		emitter->life_spread = 500;
+		emitter->size = 6;
+		emitter->size_spread = 2;
+		emitter->color.r = 255;
+		emitter->color.g = 160 + i * 12;
+		emitter->color.b = 60;
+		emitter->color.a = 255;
+		emitter->rate = EMITTER_RATE;
+	}
+
+	position_component = COMPONENT(Vector);
+	velocity_component = add_component("velocity", sizeof(Vector));
+	sprite_component = COMPONENT(Sprite);
+	health_component = COMPONENT(int);
+
+	// a third each: with sprites, with sprites and health, bare
+	ComponentMask masks[] =
+	{
+		MASK(position_component) | MASK(velocity_component) | MASK(sprite_component),
+		MASK(position_component) | MASK(velocity_component) | MASK(sprite_component) | MASK(health_component),
+		MASK(position_component) | MASK(velocity_component)
+	};
+
+	for (int m = 0; m < 3; m++)
+	{
+		int count = m < 2 ? ENTITY_COUNT / 3 : ENTITY_COUNT - ENTITY_COUNT / 3 * 2;
+		Archetype* table = get_archetype(masks[m]);
+		int first = create_entities(masks[m], count, NULL);
+		Vector* velocity = (Vector*)column(table, velocity_component);
+
+		for (int i = first; i < first + count; i++)
+		{
+			velocity[i].x = rand() % 5 - 2;
+			velocity[i].y = rand() % 5 - 2;
+		}
+	}
+
+	for (int i = 0; i < ENTITY_COUNT; i++)
+	{
+		actors[i].sprite = sprite_from_handle(tiles[i % TILE_COUNT]);
+		actors[i].velocity.x = rand() % 5 - 2;
+		actors[i].velocity.y = rand() % 5 - 2;
+		actors[i].health = 100;
+	}
+
+	bullets = POOL(Bullet, BULLET_COUNT);
+
+	start_scene(0);
+}
+
+void game_tick(const float delta)
+{
+	if (current >= SCENE_COUNT)
+		return;
+
+	if (frame > WARMUP_FRAMES && frame <= WARMUP_FRAMES + MEASURED_FRAMES)
+		measure();
+
+	if (frame == WARMUP_FRAMES + MEASURED_FRAMES)
+		set_debug_view(DEBUG_VIEW_OVERDRAW);
+
+	if (frame > WARMUP_FRAMES + MEASURED_FRAMES + 1)
+		measure_overdraw();
+
+	scenes[current].tick();
+	frame++;
+
+	if (frame > WARMUP_FRAMES + MEASURED_FRAMES + 1 + OVERDRAW_FRAMES)
+	{
+		set_debug_view(DEBUG_VIEW_NONE);
+		start_scene(current + 1);
+
+		if (current >= SCENE_COUNT)
+		{
+			write_results();
+			quit = true;
+		}
+	}
+}
+
+void game_terminate()
+{
+	unload_tilemap(&map);
+	unload_chunk_map(&chunk_map);
+	free_animations(&animations);
+	free_particles(&particles);
+	free_particles(&million);
+	free_gpu_particles(&gpu_particles);
+	destroy_all_entities();
+	free_pool(&bullets);
+
+	for (int i = 0; i < loose_bullet_count; i++)
+		free(loose_bullets[i]);
+	release_texture(sheet);
+
+	for (int i = 0; i < TILE_COUNT; i++)
+	{
+		release_texture(tiles[i]);
+
+		if (tile_layer_count > 0)
+			release_texture(tile_layers[i]);
+	}
+}
@@ -0,0 +1,101 @@
+//**************************************************
+// TEX - Proto texture file
+// header followed by the RGBA pixels of every mip level, biggest first
+// written by the texture cache and by tools bake, ready to upload as is
+//**************************************************
+
+#ifndef TEX_H
+#define TEX_H
+
+#define TEX_MAGIC 0x58455450 // PTEX
+#define TEX_VERSION 1
+
+typedef struct TexHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int width;
+	unsigned int height;
+	unsigned int levels;
+	unsigned int premultiplied;
+} TexHeader;
+
+unsigned int tex_mip_count(unsigned int width, unsigned int height)
+{
+	unsigned int result = 1;
+
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		result++;
+	}
+
+	return result;
+}
+
+// bytes of levels mips starting at width x height
+long tex_size(unsigned int width, unsigned int height, const unsigned int levels)
+{
+	long result = 0;
+
+	for (unsigned int i = 0; i < levels; i++)
+	{
+		result += width * height * 4;
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return result;
+}
+
+void tex_premultiply(unsigned char* pixels, const long count)
+{
+	for (long i = 0; i < count; i++, pixels += 4)
+	{
+		pixels[0] = pixels[0] * pixels[3] / 255;
+		pixels[1] = pixels[1] * pixels[3] / 255;
+		pixels[2] = pixels[2] * pixels[3] / 255;
+	}
+}
+
+// box filters every level from the previous one - pixels must have room for the chain
+void tex_generate_mips(unsigned char* pixels, unsigned int width, unsigned int height, const unsigned int levels)
+{
+	unsigned char* source = pixels;
+
+	for (unsigned int level = 1; level < levels; level++)
+	{
+		unsigned int mip_width = width > 1 ? width / 2 : 1;
+		unsigned int mip_height = height > 1 ? height / 2 : 1;
+		unsigned char* target = source + width * height * 4;
+
+		for (unsigned int y = 0; y < mip_height; y++)
+		{
+			unsigned int y0 = y * 2;
+			unsigned int y1 = y0 + 1 < height ? y0 + 1 : y0;
+
+			for (unsigned int x = 0; x < mip_width; x++)
+			{
+				unsigned int x0 = x * 2;
+				unsigned int x1 = x0 + 1 < width ? x0 + 1 : x0;
+
+				for (int c = 0; c < 4; c++)
+				{
+					target[(y * mip_width + x) * 4 + c] = (
+						source[(y0 * width + x0) * 4 + c] +
+						source[(y0 * width + x1) * 4 + c] +
+						source[(y1 * width + x0) * 4 + c] +
+						source[(y1 * width + x1) * 4 + c] + 2) / 4;
+				}
+			}
+		}
+
+		source = target;
+		width = mip_width;
+		height = mip_height;
+	}
+}
+
+#endif
@@ -7,11 +7,21 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include "stb_image.h"
+#include "qoi.h"
+#include "tex.h"
+#include "map.h"
+#include "dds.h"
 #include <stdbool.h>
 #include <math.h>
 #include <windows.h>
 #include <gl/gl.h>
 
+// bulk updates use SSE2 when the compiler has it - tcc doesn't and takes the plain loops
+#if defined(__SSE2__) || defined(_M_X64)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 //**************************************************
 // CONFIG
 //**************************************************
@@ -23,6 +33,16 @@ bool FULL_SCREEN = true;
 bool PIXEL_ART = false;
 bool SHOW_CURSOR = false;
 bool DEBUG = false;
+bool PREMULTIPLIED_ALPHA = false;
+char TEXTURE_CACHE[] = ""; // folder for decoded textures - empty disables it
+long TEXTURE_BUDGET = 0; // bytes of VRAM for textures - 0 is no limit
+float SHADOW_OFFSET_X = 4.f; // of sprite shadows - scaled with the sprite
+float SHADOW_OFFSET_Y = 4.f;
+int TEXTURE_SLOTS = 16; // textures one batch can mix - capped by the gpu - 1 is a texture per batch
+int CHUNK_THREADS = 4; // workers building chunk map geometry - 0 builds on the main thread only
+long FRAME_ARENA_BYTES = 4 * 1024 * 1024; // frame_alloc memory - reset every frame
+long SCRATCH_ARENA_BYTES = 4 * 1024 * 1024; // arena_mark / arena_restore temporaries
+bool COMPUTE_PARTICLES = false; // asks for a GL 4.3 context so GpuParticles run on compute shaders - they fall back to the cpu without it
 
 //**************************************************
 // GLOBALS - can be used - not defined here
@@ -34,6 +54,7 @@ Shader current_shader - shader in use
 bool input_keys[256]; // keys pressed
 bool released_keys[256]; // keys released
 bool key_any; // any key pressed
+FrameStats frame_stats; // engine counters of the last frame
 */
 
 //**************************************************
@@ -87,6 +108,40 @@ typedef struct Rect
 	uint height;
 } Rect;
 
+typedef struct Image
+{
+	uint width;
+	uint height;
+	uint levels; // mip levels packed one after the other
+	byte* pixels; // RGBA or compressed blocks
+	uint format; // 0 for RGBA - otherwise the gl compressed format
+	bool premultiplied;
+	HANDLE file; // set when the pixels are mapped from the texture cache
+	HANDLE mapping;
+} Image;
+
+typedef enum TextureFormat
+{
+	TEXTURE_RGBA,
+	TEXTURE_RGB, // opaque - alpha dropped on upload
+	TEXTURE_RGBA4444, // 16 bit formats are dithered from RGBA
+	TEXTURE_RGBA5551,
+	TEXTURE_RGB565, // opaque backgrounds
+	TEXTURE_L8, // grey masks
+	TEXTURE_A8, // black with alpha - shadows
+	TEXTURE_INDEXED // 256 color palette - always nearest without mips
+} TextureFormat;
+
+typedef struct TextureOptions
+{
+	bool nearest; // nearest filtering - linear otherwise
+	bool mipmaps;
+	bool repeat; // repeat wrap - clamp to edge otherwise
+	bool trim; // crop fully transparent borders - drawing is unchanged
+	byte hull; // max vertices of a convex mesh drawn instead of the quad - 0 is off
+	TextureFormat format;
+} TextureOptions;
+
 typedef struct Quad
 {
 	Vector top_left;
@@ -98,6 +153,7 @@ typedef struct Quad
 typedef struct
 {
     uint id;
+    word handle; // texture registry entry
     uint width;
     uint height;
 
@@ -113,6 +169,88 @@ typedef struct
     bool flip_y;
 } Texture;
 
+typedef struct Color
+{
+	byte r;
+	byte g;
+	byte b;
+	byte a;
+} Color;
+
+typedef struct SpriteRect
+{
+	word x;
+	word y;
+	word width;
+	word height;
+} SpriteRect;
+
+#define SPRITE_VISIBLE 1
+#define SPRITE_FLIP_X 2
+#define SPRITE_FLIP_Y 4
+
+// one drawn instance of an image - 36 bytes so big arrays of them stay
+// dense - any number of sprites can share the same image
+typedef struct Sprite
+{
+	Vector position;
+	float scale;
+	float rotation; // degrees
+	SpriteRect source;
+	short pivot_x;
+	short pivot_y;
+	word image; // TextureHandle
+	byte flags; // SPRITE_*
+	byte shadow; // alpha of a black copy drawn SHADOW_OFFSET away - 0 is none
+	Color color; // multiplies the texels - alpha fades the sprite
+} Sprite;
+
+// map of atlas tiles drawn on the gpu - see TILEMAP
+typedef struct Tilemap
+{
+	uint columns; // map size in tiles
+	uint rows;
+	uint tile_width; // atlas pixels
+	uint tile_height;
+	uint atlas_columns;
+	word atlas; // TextureHandle
+	GLuint map_id; // one byte index per tile
+	byte* tiles; // 0 is empty - n is atlas tile n - 1
+	Rect dirty; // tiles changed since the last upload
+	Vector position; // screen position of the top left tile
+	float scale;
+} Tilemap;
+
+#define CHUNK_TILES 16 // chunk side in tiles
+#define MAX_MAP_LAYERS MAP_MAX_LAYERS
+
+// CHUNK_TILES x CHUNK_TILES tiles of one layer as static vertices on the gpu
+typedef struct MapChunk
+{
+	GLuint buffer; // 0 until built with tiles
+	word quads; // tiles that aren't empty
+	bool dirty; // tiles changed since it was built
+} MapChunk;
+
+// layered map drawn as chunks of static geometry - see CHUNK MAPS
+typedef struct ChunkMap
+{
+	uint columns; // map size in tiles
+	uint rows;
+	uint tile_width; // atlas pixels
+	uint tile_height;
+	uint atlas_columns;
+	uint layer_count;
+	word atlas; // TextureHandle
+	MapLayer layers[MAX_MAP_LAYERS];
+	word* tiles; // layer after layer - 0 is empty - n is atlas tile n - 1
+	uint chunk_columns;
+	uint chunk_rows;
+	MapChunk* chunks; // layer after layer
+	Vector position; // screen position of the top left tile
+	float scale;
+} ChunkMap;
+
 typedef struct Shader
 {
 	word id;
@@ -120,45 +258,116 @@ typedef struct Shader
 	// locations on shader
 	uint vertex_position;
 	uint texture_position;
+	int vertex_color; // -1 when the shader has no tint
+	int texture_slot; // -1 when the shader samples a single texture
 	
 } Shader;
 
-Shader current_shader;
-Shader base_shader;
+// passes timed on the gpu
+#define GPU_PASS_CLEAR 0
+#define GPU_PASS_GAME 1
+#define GPU_PASS_DEBUG_VIEW 2
+#define GPU_PASS_OVERLAY 3
+#define GPU_PASSES 4
 
-float square_vertices[] = // dummy
+// engine counters for one frame
+typedef struct FrameStats
 {
-	-1.0f, -1.0f,
-	1.0f, -1.0f,
-	1.0f, 1.0f,
-	-1.0f, 1.0f,
-}; // 4 for square
+	uint draw_calls;
+	uint sprites; // draw calls from the game - culled ones included
+	uint vertices;
+	uint texture_binds;
+	uint program_switches;
+	uint shader_compiles;
+	long bytes_uploaded; // texture data sent to the gpu
+	uint textures_alive;
+	long texture_bytes; // VRAM resident
+	uint allocations; // engine mallocs - decoders excluded
+	long arena_bytes; // of frame_arena
+	float overdraw_average; // layers on covered pixels - 0 unless the overdraw view is on
+	uint overdraw_max;
+	float frame_ms; // between frame ends
+	float tick_ms; // cpu time in game_tick
+	float present_ms; // waiting on glFinish and SwapBuffers
+	float gpu_ms[GPU_PASSES]; // from GPU_TIMER_FRAMES - 1 frames before
+} FrameStats;
 
-float texture_vertices[] = // dummy
-{
-	0.0f, 1.0f,
-	1.0f, 1.0f,
-	1.0f, 0.0f,
-	0.0f, 0.0f
-};
+Shader current_shader;
+Shader base_shader;
+Shader palette_shader; // used by TEXTURE_INDEXED textures
+Shader multi_shader; // base_shader sampling one of several bound textures
+Shader array_shader; // layers of texture arrays - glsl 120 for sampler2DArray
 
 const string direct_vs = "#version 100
 attribute vec2 vertex_position;
 attribute vec2 texture_position;
+attribute vec4 vertex_color;
+attribute float texture_slot;
 varying vec2 texture_coordinate;
+varying vec4 tint;
+varying float slot;
 void main()
 {
 gl_Position = vec4(vertex_position, 0, 1);
 texture_coordinate = texture_position;
+tint = vertex_color;
+slot = texture_slot;
 }";
 
 const string direct_fs = "#version 100
 precision mediump float;
 varying vec2 texture_coordinate;
+varying vec4 tint;
 uniform sampler2D texture0;
 void main()
 {   
-gl_FragColor = texture2D(texture0, texture_coordinate);
+gl_FragColor = texture2D(texture0, texture_coordinate) * tint;
+}";
+
+const string palette_fs = "#version 100
+precision mediump float;
+varying vec2 texture_coordinate;
+varying vec4 tint;
+uniform sampler2D texture0;
+uniform sampler2D palette;
+void main()
+{
+float index = texture2D(texture0, texture_coordinate).r * 255.0;
+gl_FragColor = texture2D(palette, vec2((index + 0.5) / 256.0, 0.5)) * tint;
+}";
+
+const string array_vs = "#version 120
+attribute vec2 vertex_position;
+attribute vec2 texture_position;
+attribute vec4 vertex_color;
+attribute float texture_slot;
+varying vec2 texture_coordinate;
+varying vec4 tint;
+varying float slot;
+void main()
+{
+gl_Position = vec4(vertex_position, 0, 1);
+texture_coordinate = texture_position;
+tint = vertex_color;
+slot = texture_slot;
+}";
+
+// slot is the layer
+const string array_fs = "#version 120
+#extension GL_EXT_texture_array : require
+varying vec2 texture_coordinate;
+varying vec4 tint;
+varying float slot;
+uniform sampler2DArray texture0;
+void main()
+{
+gl_FragColor = texture2DArray(texture0, vec3(texture_coordinate, slot)) * tint;
+}";
+
+// main of multi texture shaders - texel() samples the vertex slot
+const string multi_main = "void main()
+{
+gl_FragColor = texel() * tint;
 }";
 
 //**************************************************
@@ -179,6 +388,39 @@ bool key_up(const char key)
 	return released_keys[key];
 }
 
+//**************************************************
+// STATS
+//**************************************************
+
+FrameStats current_stats; // filling up - frame_stats has the last complete frame
+FrameStats frame_stats;
+LARGE_INTEGER timer_frequency;
+
+double now_ms()
+{
+    LARGE_INTEGER counter;
+
+    if (timer_frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&timer_frequency);
+
+    QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart * 1000.0 / timer_frequency.QuadPart;
+}
+
+void* counted_malloc(const long size)
+{
+    current_stats.allocations++;
+
+    return malloc(size);
+}
+
+void* counted_realloc(void* data, const long size)
+{
+    current_stats.allocations++;
+
+    return realloc(data, size);
+}
 
 //**************************************************
 // FUNCTIONS
@@ -217,12 +459,22 @@ DataHolder load_file(const string filename)
     debug("Opening file %s", filename);
     
     FILE* file = fopen(filename, "rb");
+
+    if (file == NULL)
+    {
+        debug("Failed to open file %s", filename);
+
+        result.length = 0;
+        result.data = NULL;
+
+        return result;
+    }
     
     fseek(file, 0, SEEK_END);
     result.length = ftell(file);
     rewind(file);
 
-    result.data = (byte*)malloc(result.length * sizeof(byte));
+    result.data = (byte*)counted_malloc(result.length * sizeof(byte));
 
     fread(result.data, sizeof(byte), result.length, file);
     fclose(file);
@@ -234,14 +486,23 @@ char* load_text(const string filename)
 {
     DataHolder holder = load_file(filename);
 
-    string result = (char*)malloc(holder.length * sizeof(byte));    
-    memcpy(result, holder.data, holder.length);
+    // the file buffer itself with a terminator - no second copy
+    string result = (char*)counted_realloc(holder.data, holder.length + 1);
+
+    if (result != NULL)
+        result[holder.length] = 0;
 
-    free(holder.data);
-    
     return result;  
 }
 
+bool has_extension(const string filename, const string extension)
+{
+    int length = strlen(filename);
+    int extension_length = strlen(extension);
+
+    return length >= extension_length &&
+        _stricmp(filename + length - extension_length, extension) == 0;
+}
 
 float to_degrees(const float radians)
 {
@@ -389,14 +650,43 @@ Vector center(const Quad quad)
     return result;
 }
 
-Quad calculate_quad(const Texture texture)
+Sprite sprite_from_texture(const Texture* texture)
+{
+    Sprite result;
+
+    result.position = texture->position;
+    result.scale = texture->scale;
+    result.rotation = texture->rotation;
+    result.source.x = texture->source.x;
+    result.source.y = texture->source.y;
+    result.source.width = texture->source.width;
+    result.source.height = texture->source.height;
+    result.pivot_x = texture->pivot.x;
+    result.pivot_y = texture->pivot.y;
+    result.image = texture->handle;
+    result.shadow = texture->shadow;
+    result.color.r = 255;
+    result.color.g = 255;
+    result.color.b = 255;
+    result.color.a = texture->alpha;
+    result.flags =
+        (texture->visible ? SPRITE_VISIBLE : 0) |
+        (texture->flip_x ? SPRITE_FLIP_X : 0) |
+        (texture->flip_y ? SPRITE_FLIP_Y : 0);
+
+    return result;
+}
+
+Quad sprite_quad(const Sprite* sprite)
 {
-    float angle = to_radians(texture.rotation);
-    Vector position = texture.position;
-    Vector pivot = texture.pivot;
-    float scale = texture.scale;
-    int source_width = texture.source.width;
-    int source_height = texture.source.height;
+    float angle = to_radians(sprite->rotation);
+    Vector position = sprite->position;
+    Vector pivot = { sprite->pivot_x, sprite->pivot_y };
+    float scale = sprite->scale;
+    int source_width = sprite->source.width;
+    int source_height = sprite->source.height;
+    bool flip_x = sprite->flags & SPRITE_FLIP_X;
+    bool flip_y = sprite->flags & SPRITE_FLIP_Y;
 
     if (scale != 1.0f)
     {
@@ -420,10 +710,10 @@ Quad calculate_quad(const Texture texture)
 
     if (angle != 0)
     {
-        if (texture.flip_x)
+        if (flip_x)
             pivot.x = source_width - pivot.x;
 
-        if (texture.flip_y)
+        if (flip_y)
             pivot.y = source_height - pivot.y;
 
         add(&pivot, position);
@@ -434,7 +724,7 @@ Quad calculate_quad(const Texture texture)
         rotate(&bottom_left, pivot, angle);
     }
 
-    if (texture.flip_x)
+    if (flip_x)
     {
         Vector aux = top_left;
         top_left = top_right;
@@ -445,7 +735,7 @@ Quad calculate_quad(const Texture texture)
         bottom_right = aux;
     }
 
-    if (texture.flip_y)
+    if (flip_y)
     {
         Vector aux = top_left;
         top_left = bottom_left;
@@ -467,444 +757,5830 @@ Quad calculate_quad(const Texture texture)
     return result;
 }
 
+Quad calculate_quad(const Texture texture)
+{
+    Sprite sprite = sprite_from_texture(&texture);
+
+    return sprite_quad(&sprite);
+}
+
 //**************************************************
-// OPENGL
+// POOLS
 //**************************************************
 
-typedef BOOL (WINAPI * PFNWGLCHOOSEPIXELFORMATARBPROC) (HDC hdc, const int *piAttribIList, const FLOAT *pfAttribFList, UINT nMaxFormats, int *piFormats, UINT *nNumFormats);
-typedef HGLRC (WINAPI * PFNWGLCREATECONTEXTATTRIBSARBPROC) (HDC hDC, HGLRC hShareContext, const int *attribList);
-typedef BOOL (WINAPI * PFNWGLSWAPINTERVALEXTPROC) (int interval);
-typedef void (APIENTRY * PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
-typedef void (APIENTRY * PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
-typedef void (APIENTRY * PFNGLBINDVERTEXARRAYPROC) (GLuint array);
-typedef void (APIENTRY * PFNGLBUFFERDATAPROC) (GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
-typedef void (APIENTRY * PFNGLCOMPILESHADERPROC) (GLuint shader);
-typedef GLuint (APIENTRY * PFNGLCREATEPROGRAMPROC) (void);
-typedef GLuint (APIENTRY * PFNGLCREATESHADERPROC) (GLenum type);
-typedef void (APIENTRY * PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
-typedef void (APIENTRY * PFNGLDELETEPROGRAMPROC) (GLuint program);
-typedef void (APIENTRY * PFNGLDELETESHADERPROC) (GLuint shader);
-typedef void (APIENTRY * PFNGLDELETEVERTEXARRAYSPROC) (GLsizei n, const GLuint *arrays);
-typedef void (APIENTRY * PFNGLDETACHSHADERPROC) (GLuint program, GLuint shader);
-typedef void (APIENTRY * PFNGLENABLEVERTEXATTRIBARRAYPROC) (GLuint index);
-typedef void (APIENTRY * PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
-typedef void (APIENTRY * PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
-typedef GLint (APIENTRY * PFNGLGETATTRIBLOCATIONPROC) (GLuint program, const char *name);
-typedef void (APIENTRY * PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, char *infoLog);
-typedef void (APIENTRY * PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
-typedef void (APIENTRY * PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, char *infoLog);
-typedef void (APIENTRY * PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
-typedef void (APIENTRY * PFNGLLINKPROGRAMPROC) (GLuint program);
-typedef void (APIENTRY * PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const char* *string, const GLint *length);
-typedef void (APIENTRY * PFNGLUSEPROGRAMPROC) (GLuint program);
-typedef void (APIENTRY * PFNGLVERTEXATTRIBPOINTERPROC) (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
-typedef void (APIENTRY * PFNGLBINDATTRIBLOCATIONPROC) (GLuint program, GLuint index, const char *name);
-typedef GLint (APIENTRY * PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const char *name);
-typedef void (APIENTRY * PFNGLUNIFORMMATRIX4FVPROC) (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
-typedef void (APIENTRY * PFNGLACTIVETEXTUREPROC) (GLenum texture);
-typedef void (APIENTRY * PFNGLUNIFORM1IPROC) (GLint location, GLint v0);
-typedef void (APIENTRY * PFNGLGENERATEMIPMAPPROC) (GLenum target);
-typedef void (APIENTRY * PFNGLDISABLEVERTEXATTRIBARRAYPROC) (GLuint index);
-typedef void (APIENTRY * PFNGLUNIFORM1FPROC) (GLint location, GLfloat v0);
-typedef void (APIENTRY * PFNGLUNIFORM2FPROC) (GLint location, GLfloat v0);
-typedef void (APIENTRY * PFNGLUNIFORM3FVPROC) (GLint location, GLsizei count, const GLfloat *value);
-typedef void (APIENTRY * PFNGLUNIFORM4FVPROC) (GLint location, GLsizei count, const GLfloat *value);
-typedef void (APIENTRY * PFNGLVEXTEXATTRIB3FPROC) (GLuint index, GLfloat v0, GLfloat v1, GLfloat v2);
-typedef void (APIENTRY * PFNGLUNIFORM4FPROC) (GLuint index, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+// fixed capacity pools of one type of object - bullets, pickups, effects
+// all memory comes at create_pool, so spawning and killing during the game
+// never touches the heap - alloc and free pop and push a stack of free slots
+// objects keep their slot (pointers stay valid until freed) and the live
+// ones are also listed densely, so POOL_EACH walks only those:
+//     Pool bullets = POOL(Bullet, 1024);
+//     Bullet* bullet = POOL_ALLOC(&bullets, Bullet);
+//     Bullet* b;
+//     POOL_EACH(&bullets, Bullet, b) { if (b->life <= 0) pool_free(&bullets, b); }
+// POOL_EACH goes backwards so freeing the current object is safe - freeing
+// any other one during the walk moves an object that was already visited
+// into its place, which then comes up a second time
+// handles go stale when the object is freed - the pointer does not know
+
+#define MAX_POOL_CAPACITY 65536 // slot is the low word of a handle
+
+typedef uint PoolHandle; // 0 is none
+
+typedef struct Pool
+{
+    int item_size;
+    int capacity;
+    int count; // live objects
+    int peak; // most live at once
+    int refused; // allocs with the pool full
+    byte* items; // capacity slots
+    word* live; // slot of every live object - count used
+    word* live_index; // position on live of every slot
+    word* generation;
+    word* free_slots; // stack
+    int free_count;
+} Pool;
+
+typedef struct PoolStats
+{
+    int count;
+    int capacity;
+    int peak;
+    int refused;
+    int span; // up to the highest live slot
+    float fragmentation; // free slots inside the span - 0 to 1
+} PoolStats;
+
+#define POOL(type, capacity) create_pool(sizeof(type), capacity)
+#define POOL_ALLOC(pool, type) ((type*)pool_alloc(pool))
+#define POOL_GET(pool, type, handle) ((type*)pool_get(pool, handle))
+// item is declared by the caller
+#define POOL_EACH(pool, type, item) \
+    for (int item##_index = (pool)->count - 1; \
+        item##_index >= 0 && ((item = (type*)pool_live(pool, item##_index)), 1); item##_index--)
+
+Pool create_pool(const int item_size, int capacity)
+{
+    Pool result;
 
-#define WGL_DRAW_TO_WINDOW_ARB         0x2001
-#define WGL_ACCELERATION_ARB           0x2003
-#define WGL_SWAP_METHOD_ARB            0x2007
-#define WGL_SUPPORT_OPENGL_ARB         0x2010
-#define WGL_DOUBLE_BUFFER_ARB          0x2011
-#define WGL_PIXEL_TYPE_ARB             0x2013
-#define WGL_COLOR_BITS_ARB             0x2014
-#define WGL_DEPTH_BITS_ARB             0x2022
-#define WGL_STENCIL_BITS_ARB           0x2023
-#define WGL_FULL_ACCELERATION_ARB      0x2027
-#define WGL_SWAP_EXCHANGE_ARB          0x2028
-#define WGL_TYPE_RGBA_ARB              0x202B
-#define WGL_CONTEXT_MAJOR_VERSION_ARB  0x2091
-#define WGL_CONTEXT_MINOR_VERSION_ARB  0x2092
+    if (capacity > MAX_POOL_CAPACITY)
+    {
+        debug("Pool of %i capped to %i", capacity, MAX_POOL_CAPACITY);
+        capacity = MAX_POOL_CAPACITY;
+    }
 
-#define GL_ARRAY_BUFFER                   0x8892
-#define GL_STATIC_DRAW                    0x88E4
-#define GL_FRAGMENT_SHADER                0x8B30
-#define GL_VERTEX_SHADER                  0x8B31
-#define GL_COMPILE_STATUS                 0x8B81
-#define GL_LINK_STATUS                    0x8B82
-#define GL_INFO_LOG_LENGTH                0x8B84
-#define GL_TEXTURE0                       0x84C0
-#define GL_BGRA                           0x80E1
-#define GL_ELEMENT_ARRAY_BUFFER           0x8893
-#define GL_CLAMP_TO_EDGE                  0x812F
-#define GL_GENERATE_MIPMAP_HINT           0x8192
+    memset(&result, 0, sizeof(Pool));
+    result.item_size = item_size;
+    result.capacity = capacity;
+    result.items = (byte*)counted_malloc((long)capacity * item_size);
+    result.live = (word*)counted_malloc(capacity * sizeof(word));
+    result.live_index = (word*)counted_malloc(capacity * sizeof(word));
+    result.generation = (word*)counted_malloc(capacity * sizeof(word));
+    result.free_slots = (word*)counted_malloc(capacity * sizeof(word));
 
-PFNGLUSEPROGRAMPROC glUseProgram;
-PFNGLATTACHSHADERPROC glAttachShader;
-PFNGLBINDBUFFERPROC glBindBuffer;
-PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
-PFNGLBUFFERDATAPROC glBufferData;
-PFNGLCOMPILESHADERPROC glCompileShader;
-PFNGLCREATEPROGRAMPROC glCreateProgram;
-PFNGLCREATESHADERPROC glCreateShader;
-PFNGLDELETEBUFFERSPROC glDeleteBuffers;
-PFNGLDELETEPROGRAMPROC glDeleteProgram;
-PFNGLDELETESHADERPROC glDeleteShader;
-PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
-PFNGLDETACHSHADERPROC glDetachShader;
-PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
-PFNGLGENBUFFERSPROC glGenBuffers;
-PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
-PFNGLGETATTRIBLOCATIONPROC glGetAttribLocation;
-PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
-PFNGLGETPROGRAMIVPROC glGetProgramiv;
-PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
-PFNGLGETSHADERIVPROC glGetShaderiv;
-PFNGLLINKPROGRAMPROC glLinkProgram;
-PFNGLSHADERSOURCEPROC glShaderSource;
-PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
-PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
-PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
-PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
-PFNGLACTIVETEXTUREPROC glActiveTexture;
-PFNGLUNIFORM1IPROC glUniform1i;
-PFNGLGENERATEMIPMAPPROC glGenerateMipmap;
-PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
-PFNGLUNIFORM1FPROC glUniform1f;
-PFNGLUNIFORM2FPROC glUniform2f;
-PFNGLUNIFORM3FVPROC glUniform3fv;
-PFNGLUNIFORM4FVPROC glUniform4fv;
-PFNGLVEXTEXATTRIB3FPROC glVertexAttrib3f;
-PFNGLUNIFORM4FPROC glUniform4f;
+    memset(result.generation, 0, capacity * sizeof(word));
 
-PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormatARB;
-PFNWGLCREATECONTEXTATTRIBSARBPROC wglCreateContextAttribsARB;
-PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT;
+    // slot 0 on top - the first objects are together
+    for (int i = 0; i < capacity; i++)
+        result.free_slots[i] = capacity - 1 - i;
 
-void load_opengl_extensions()
+    result.free_count = capacity;
+
+    return result;
+}
+
+void free_pool(Pool* pool)
 {
-	wglChoosePixelFormatARB = (PFNWGLCHOOSEPIXELFORMATARBPROC)wglGetProcAddress("wglChoosePixelFormatARB");
-	wglCreateContextAttribsARB = (PFNWGLCREATECONTEXTATTRIBSARBPROC)wglGetProcAddress("wglCreateContextAttribsARB");
-	wglSwapIntervalEXT = (PFNWGLSWAPINTERVALEXTPROC)wglGetProcAddress("wglSwapIntervalEXT");
-	glAttachShader = (PFNGLATTACHSHADERPROC)wglGetProcAddress("glAttachShader");
-	glBindBuffer = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
-	glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)wglGetProcAddress("glBindVertexArray");
-	glBufferData = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
-	glCompileShader = (PFNGLCOMPILESHADERPROC)wglGetProcAddress("glCompileShader");
-	glCreateProgram = (PFNGLCREATEPROGRAMPROC)wglGetProcAddress("glCreateProgram");
-	glCreateShader = (PFNGLCREATESHADERPROC)wglGetProcAddress("glCreateShader");
-	glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
-	glDeleteProgram = (PFNGLDELETEPROGRAMPROC)wglGetProcAddress("glDeleteProgram");
-	glDeleteShader = (PFNGLDELETESHADERPROC)wglGetProcAddress("glDeleteShader");
-	glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)wglGetProcAddress("glDeleteVertexArrays");
-	glDetachShader = (PFNGLDETACHSHADERPROC)wglGetProcAddress("glDetachShader");
-	glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glEnableVertexAttribArray");
-	glGenBuffers = (PFNGLGENBUFFERSPROC)wglGetProcAddress("glGenBuffers");
-	glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)wglGetProcAddress("glGenVertexArrays");
-	glGetAttribLocation = (PFNGLGETATTRIBLOCATIONPROC)wglGetProcAddress("glGetAttribLocation");
-	glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)wglGetProcAddress("glGetProgramInfoLog");
-	glGetProgramiv = (PFNGLGETPROGRAMIVPROC)wglGetProcAddress("glGetProgramiv");
-	glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)wglGetProcAddress("glGetShaderInfoLog");
-	glGetShaderiv = (PFNGLGETSHADERIVPROC)wglGetProcAddress("glGetShaderiv");
-	glLinkProgram = (PFNGLLINKPROGRAMPROC)wglGetProcAddress("glLinkProgram");
-	glShaderSource = (PFNGLSHADERSOURCEPROC)wglGetProcAddress("glShaderSource");
-	glUseProgram = (PFNGLUSEPROGRAMPROC)wglGetProcAddress("glUseProgram");
-	glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)wglGetProcAddress("glVertexAttribPointer");
-	glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC)wglGetProcAddress("glBindAttribLocation");
-	glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)wglGetProcAddress("glGetUniformLocation");
-	glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVPROC)wglGetProcAddress("glUniformMatrix4fv");
-	glActiveTexture = (PFNGLACTIVETEXTUREPROC)wglGetProcAddress("glActiveTexture");
-	glUniform1i = (PFNGLUNIFORM1IPROC)wglGetProcAddress("glUniform1i");
-	glGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)wglGetProcAddress("glGenerateMipmap");
-	glDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glDisableVertexAttribArray");
-	glUniform1f = (PFNGLUNIFORM1FPROC)wglGetProcAddress("glUniform1f");
-	glUniform2f = (PFNGLUNIFORM2FPROC)wglGetProcAddress("glUniform2f");
-	glUniform3fv = (PFNGLUNIFORM3FVPROC)wglGetProcAddress("glUniform3fv");
-	glUniform4fv = (PFNGLUNIFORM4FVPROC)wglGetProcAddress("glUniform4fv");
-	glVertexAttrib3f = (PFNGLVEXTEXATTRIB3FPROC)wglGetProcAddress("glVertexAttrib3f");
-	glUniform4f = (PFNGLUNIFORM4FPROC)wglGetProcAddress("glUniform4f");
+    free(pool->items);
+    free(pool->live);
+    free(pool->live_index);
+    free(pool->generation);
+    free(pool->free_slots);
+
+    memset(pool, 0, sizeof(Pool));
 }
 
-Texture load_texture(string filename)
+// a zeroed object - NULL when the pool is full
+void* pool_alloc(Pool* pool)
 {
-    int width, height, comp;
-    unsigned char* image = stbi_load(filename, &width, &height, &comp, STBI_rgb_alpha);
+    if (pool->free_count == 0)
+    {
+        pool->refused++;
+        return NULL;
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0); // Free any old binding
+    int slot = pool->free_slots[--pool->free_count];
+    byte* item = pool->items + (long)slot * pool->item_size;
 
-    GLuint id = 0;
+    pool->live_index[slot] = pool->count;
+    pool->live[pool->count++] = slot;
 
-    glGenTextures(1, &id); // Generate Pointer to the texture
+    if (pool->count > pool->peak)
+        pool->peak = pool->count;
 
-    glBindTexture(GL_TEXTURE_2D, id);
+    memset(item, 0, pool->item_size);
 
-	glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA,
-        width,
-        height,
-        0,
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        image);
+    return item;
+}
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+int pool_slot(const Pool* pool, const void* item)
+{
+    return ((const byte*)item - pool->items) / pool->item_size;
+}
 
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+// never 0 so no handle is 0
+uint pool_tag(const Pool* pool, const int slot)
+{
+    return pool->generation[slot] % 0xFFFF + 1;
+}
 
-	if (PIXEL_ART) 
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+PoolHandle pool_handle(const Pool* pool, const void* item)
+{
+    int slot = pool_slot(pool, item);
+
+    return pool_tag(pool, slot) << 16 | slot;
+}
+
+// NULL once the object was freed
+void* pool_get(const Pool* pool, const PoolHandle handle)
+{
+    int slot = handle & 0xFFFF;
+
+    if (handle == 0 || slot >= pool->capacity || pool_tag(pool, slot) != handle >> 16)
+        return NULL;
+
+    return pool->items + (long)slot * pool->item_size;
+}
+
+// true for a live object of this pool - not freed, not from elsewhere
+bool pool_owns(const Pool* pool, const void* item)
+{
+    long offset = (const byte*)item - pool->items;
+
+    if (item == NULL || offset < 0 || offset >= (long)pool->capacity * pool->item_size || offset % pool->item_size != 0)
+        return false;
+
+    int slot = offset / pool->item_size;
+
+    return pool->live_index[slot] < pool->count && pool->live[pool->live_index[slot]] == slot;
+}
+
+// the last live one takes the place of the freed one on the live list
+// double frees and objects of other pools are logged and ignored
+void pool_free(Pool* pool, void* item)
+{
+    if (item == NULL)
+        return;
+
+    if (! pool_owns(pool, item))
+    {
+        debug("Pool free of %p ignored - not a live object of this pool", item);
+        return;
+    }
+
+    int slot = pool_slot(pool, item);
+    int index = pool->live_index[slot];
+    int last = pool->live[--pool->count];
+
+    pool->live[index] = last;
+    pool->live_index[last] = index;
+    pool->generation[slot]++;
+    pool->free_slots[pool->free_count++] = slot;
+}
+
+bool pool_release(Pool* pool, const PoolHandle handle)
+{
+    void* item = pool_get(pool, handle);
+
+    pool_free(pool, item);
+
+    return item != NULL;
+}
+
+// i of the count live objects - for POOL_EACH
+void* pool_live(const Pool* pool, const int i)
+{
+    return pool->items + (long)pool->live[i] * pool->item_size;
+}
+
+// frees every object - handles to them go stale
+void clear_pool(Pool* pool)
+{
+    while (pool->count > 0)
+        pool_free(pool, pool_live(pool, pool->count - 1));
+}
+
+PoolStats pool_stats(const Pool* pool)
+{
+    PoolStats result;
+    int highest = -1;
+
+    for (int i = 0; i < pool->count; i++)
+        if (pool->live[i] > highest)
+            highest = pool->live[i];
+
+    result.count = pool->count;
+    result.capacity = pool->capacity;
+    result.peak = pool->peak;
+    result.refused = pool->refused;
+    result.span = highest + 1;
+    result.fragmentation = result.span > 0 ? 1.f - (float)pool->count / result.span : 0;
+
+    return result;
+}
+
+void debug_pool(const string name, const Pool* pool)
+{
+    PoolStats stats = pool_stats(pool);
+
+    debug("Pool %s: %i of %i live, peak %i, %i refused, %.0f%% fragmented",
+        name, stats.count, stats.capacity, stats.peak, stats.refused, stats.fragmentation * 100.f);
+}
+
+//**************************************************
+// ARENAS
+//**************************************************
+
+// bump allocators for memory that dies young - an alloc moves a pointer
+// and freeing is moving it back, all at once
+// frame_arena is reset at the end of every main loop iteration - anything
+// frame_alloc or frame_format hand out lives until then, never call free
+// scratch_arena works in scopes, for temporaries inside a function:
+//     long mark = arena_mark(&scratch_arena);
+//     Vector* points = (Vector*)arena_alloc(&scratch_arena, bytes);
+//     ...
+//     arena_restore(&scratch_arena, mark);
+// with DEBUG released bytes are filled with ARENA_POISON so reads of dead
+// memory show up, and a scratch mark left open is logged at the frame end
+
+#define ARENA_ALIGN 16
+#define ARENA_POISON 0xCD
+
+typedef struct Arena
+{
+    byte* data;
+    long size;
+    long used;
+    long peak; // most used at once
+    int refused; // allocs that didn't fit
+} Arena;
+
+Arena frame_arena;
+Arena scratch_arena;
+
+Arena create_arena(const long size)
+{
+    Arena result;
+
+    memset(&result, 0, sizeof(Arena));
+    result.data = (byte*)counted_malloc(size);
+    result.size = result.data != NULL ? size : 0;
+
+    if (DEBUG && result.data != NULL)
+        memset(result.data, ARENA_POISON, size);
+
+    return result;
+}
+
+void free_arena(Arena* arena)
+{
+    free(arena->data);
+    memset(arena, 0, sizeof(Arena));
+}
+
+// where the next alloc goes
+long arena_start(const Arena* arena)
+{
+    return (arena->used + ARENA_ALIGN - 1) & ~(long)(ARENA_ALIGN - 1);
+}
+
+// ARENA_ALIGN aligned and not cleared - NULL when it doesn't fit
+void* arena_alloc(Arena* arena, const long size)
+{
+    long start = arena_start(arena);
+
+    if (size < 0 || start + size > arena->size)
+    {
+        if (arena->refused++ == 0)
+            debug("Arena of %li bytes full - %li asked with %li used", arena->size, size, arena->used);
+
+        return NULL;
+    }
+
+    arena->used = start + size;
+
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+
+    return arena->data + start;
+}
+
+long arena_mark(const Arena* arena)
+{
+    return arena->used;
+}
+
+// frees everything allocated after mark
+void arena_restore(Arena* arena, const long mark)
+{
+    if (mark >= arena->used)
+        return;
+
+    if (DEBUG)
+        memset(arena->data + mark, ARENA_POISON, arena->used - mark);
+
+    arena->used = mark;
+}
+
+void reset_arena(Arena* arena)
+{
+    arena_restore(arena, 0);
+}
+
+void* frame_alloc(const long size)
+{
+    return arena_alloc(&frame_arena, size);
+}
+
+// printf into the frame arena - "" when it doesn't fit
+string frame_format(const char* format, ...)
+{
+    long start = arena_start(&frame_arena);
+    long room = frame_arena.size - start;
+
+    if (room <= 1)
+    {
+        frame_arena.refused++;
+        return "";
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf((char*)frame_arena.data + start, room, format, arguments);
+    va_end(arguments);
+
+    // msvcrt returns -1 when the text is cut
+    if (length < 0 || length >= room)
+    {
+        frame_arena.refused++;
+
+        if (DEBUG)
+            memset(frame_arena.data + start, ARENA_POISON, room);
+
+        return "";
+    }
+
+    // the text is already at the aligned start - this only moves used
+    return (string)arena_alloc(&frame_arena, length + 1);
+}
+
+void load_arenas()
+{
+    frame_arena = create_arena(FRAME_ARENA_BYTES);
+    scratch_arena = create_arena(SCRATCH_ARENA_BYTES);
+}
+
+void unload_arenas()
+{
+    debug("Frame arena peak %li of %li bytes, %i refused - scratch arena peak %li of %li bytes, %i refused",
+        frame_arena.peak, frame_arena.size, frame_arena.refused,
+        scratch_arena.peak, scratch_arena.size, scratch_arena.refused);
+
+    free_arena(&frame_arena);
+    free_arena(&scratch_arena);
+}
+
+// end of a main loop iteration - the frame memory goes back
+void end_frame_arenas()
+{
+    if (scratch_arena.used != 0)
+    {
+        debug("Scratch arena at %li bytes at the frame end - a mark was not restored", scratch_arena.used);
+        reset_arena(&scratch_arena);
+    }
+
+    reset_arena(&frame_arena);
+}
+
+//**************************************************
+// IMAGES
+//**************************************************
+
+// 64 bit FNV-1a
+unsigned long long hash_data(const void* data, const long length, unsigned long long hash)
+{
+    const byte* bytes = (const byte*)data;
+
+    for (long i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+// cache entries are keyed by the source path, size and last write time - no need to read the png
+bool cache_path(const string filename, char* path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+    if (! GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes))
+        return false;
+
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    hash = hash_data(filename, strlen(filename), hash);
+    hash = hash_data(&attributes.nFileSizeLow, sizeof(DWORD), hash);
+    hash = hash_data(&attributes.nFileSizeHigh, sizeof(DWORD), hash);
+    hash = hash_data(&attributes.ftLastWriteTime, sizeof(FILETIME), hash);
+
+    sprintf(path, "%s/%08x%08x.tex", TEXTURE_CACHE, (uint)(hash >> 32), (uint)hash);
+
+    return true;
+}
+
+// maps a .tex file - pixels stay on the file until unload_image
+bool map_tex_file(const string path, Image* image)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD length = GetFileSize(file, NULL);
+    HANDLE mapping = length >= sizeof(TexHeader) ?
+        CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    byte* view = mapping != NULL ?
+        (byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (view != NULL)
+    {
+        TexHeader* header = (TexHeader*)view;
+
+        if (header->magic == TEX_MAGIC &&
+            header->version == TEX_VERSION &&
+            length >= sizeof(TexHeader) + tex_size(header->width, header->height, header->levels))
+        {
+            image->width = header->width;
+            image->height = header->height;
+            image->levels = header->levels;
+            image->pixels = view + sizeof(TexHeader);
+            image->format = 0;
+            image->premultiplied = header->premultiplied;
+            image->file = file;
+            image->mapping = mapping;
+
+            return true;
+        }
+
+        UnmapViewOfFile(view);
+    }
+
+    if (mapping != NULL)
+        CloseHandle(mapping);
+
+    CloseHandle(file);
+
+    return false;
+}
+
+void save_cached_image(const string path, const Image* image)
+{
+    CreateDirectoryA(TEXTURE_CACHE, NULL);
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        debug("Failed to write texture cache %s", path);
+        return;
+    }
+
+    TexHeader header;
+    header.magic = TEX_MAGIC;
+    header.version = TEX_VERSION;
+    header.width = image->width;
+    header.height = image->height;
+    header.levels = image->levels;
+    header.premultiplied = PREMULTIPLIED_ALPHA;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(image->pixels, tex_size(image->width, image->height, image->levels), 1, file);
+    fclose(file);
+}
+
+bool has_gl_extension(const string name)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+
+    return extensions != NULL && strstr(extensions, name) != NULL;
+}
+
+bool compressed_format_supported(const uint format)
+{
+    switch (format)
+    {
+    case DDS_BC1:
+    case DDS_BC2:
+    case DDS_BC3:
+        return has_gl_extension("GL_EXT_texture_compression_s3tc");
+
+    case DDS_BC7:
+        return has_gl_extension("GL_ARB_texture_compression_bptc");
+
+    case DDS_ETC1:
+    case DDS_ETC2_RGB:
+    case DDS_ETC2_RGB_A1:
+    case DDS_ETC2_RGBA:
+        return has_gl_extension("GL_ARB_ES3_compatibility");
+    }
+
+    return false;
+}
+
+// dds and ktx - blocks are uploaded as they are when the driver has the
+// format, BC1/BC2/BC3 get decompressed to RGBA otherwise
+// premultiplied alpha has to be baked into compressed files
+Image load_compressed_image(const string filename)
+{
+    Image result;
+    BlockImage blocks;
+
+    result.width = result.height = 0;
+    result.pixels = NULL;
+    result.file = NULL;
+    result.mapping = NULL;
+
+    DataHolder holder = load_file(filename);
+
+    bool parsed = has_extension(filename, ".dds") ?
+        dds_parse(holder.data, holder.length, &blocks) :
+        ktx_parse(holder.data, holder.length, &blocks);
+
+    if (! parsed)
+    {
+        debug("Failed to load compressed image %s", filename);
+        free(holder.data);
+        return result;
+    }
+
+    result.width = blocks.width;
+    result.height = blocks.height;
+    result.levels = blocks.levels;
+
+    if (compressed_format_supported(blocks.format))
+    {
+        long length = 0;
+
+        for (uint i = 0; i < blocks.levels; i++)
+            length += blocks.level_size[i];
+
+        result.pixels = (byte*)counted_malloc(length);
+        result.format = blocks.format;
+        result.premultiplied = PREMULTIPLIED_ALPHA;
+
+        byte* target = result.pixels;
+
+        for (uint i = 0; i < blocks.levels; i++)
+        {
+            memcpy(target, blocks.level_data[i], blocks.level_size[i]);
+            target += blocks.level_size[i];
+        }
+    }
+    else if (dds_can_decompress(blocks.format))
+    {
+        debug("Compressed format 0x%x not supported by the driver - decompressing %s", blocks.format, filename);
+
+        result.pixels = (byte*)counted_malloc(tex_size(blocks.width, blocks.height, blocks.levels));
+        result.format = 0;
+        result.premultiplied = PREMULTIPLIED_ALPHA;
+
+        byte* target = result.pixels;
+        uint width = blocks.width;
+        uint height = blocks.height;
+
+        for (uint i = 0; i < blocks.levels; i++)
+        {
+            dds_decompress(&blocks, i, target);
+
+            target += width * height * 4;
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+
+        if (PREMULTIPLIED_ALPHA)
+            tex_premultiply(result.pixels, tex_size(blocks.width, blocks.height, blocks.levels) / 4);
+    }
+    else
+    {
+        debug("Compressed format 0x%x not supported by the driver %s", blocks.format, filename);
+        result.width = result.height = 0;
+    }
+
+    free(holder.data);
+
+    return result;
+}
+
+void unload_image(Image* image)
+{
+    if (image->mapping != NULL)
+    {
+        UnmapViewOfFile(image->pixels - sizeof(TexHeader));
+        CloseHandle(image->mapping);
+        CloseHandle(image->file);
+    }
+    else
+        free(image->pixels);
+
+    image->pixels = NULL;
+    image->file = NULL;
+    image->mapping = NULL;
+}
+
+Image load_image(const string filename)
+{
+    Image result;
+    char path[MAX_PATH];
+    bool cached = TEXTURE_CACHE[0] != 0 && cache_path(filename, path);
+
+    if (has_extension(filename, ".dds") || has_extension(filename, ".ktx"))
+        return load_compressed_image(filename);
+
+    if (has_extension(filename, ".tex"))
+    {
+        if (! map_tex_file(filename, &result))
+        {
+            debug("Failed to load image %s", filename);
+            result.width = result.height = 0;
+            result.pixels = NULL;
+            return result;
+        }
+
+        if (PREMULTIPLIED_ALPHA && ! result.premultiplied)
+        {
+            long length = tex_size(result.width, result.height, result.levels);
+            byte* pixels = (byte*)counted_malloc(length);
+
+            memcpy(pixels, result.pixels, length);
+            tex_premultiply(pixels, length / 4);
+
+            unload_image(&result);
+            result.pixels = pixels;
+            result.premultiplied = true;
+        }
+
+        return result;
+    }
+
+    if (cached && map_tex_file(path, &result))
+    {
+        if (result.premultiplied == PREMULTIPLIED_ALPHA)
+        {
+            debug("Texture cache hit %s -> %s", filename, path);
+            return result;
+        }
+
+        unload_image(&result);
+    }
+
+    int width, height, comp;
+    byte* pixels;
+
+    if (has_extension(filename, ".qoi"))
+    {
+        DataHolder holder = load_file(filename);
+
+        pixels = qoi_decode(holder.data, holder.length, (uint*)&width, (uint*)&height);
+        free(holder.data);
+    }
+    else
+        pixels = stbi_load(filename, &width, &height, &comp, STBI_rgb_alpha);
+
+    result.width = width;
+    result.height = height;
+    result.levels = 1;
+    result.pixels = pixels;
+    result.format = 0;
+    result.premultiplied = PREMULTIPLIED_ALPHA;
+    result.file = NULL;
+    result.mapping = NULL;
+
+    if (pixels == NULL)
+    {
+        debug("Failed to load image %s", filename);
+        result.width = result.height = 0;
+        return result;
+    }
+
+    if (PREMULTIPLIED_ALPHA)
+        tex_premultiply(pixels, width * height);
+
+    if (cached)
+    {
+        // the cache stores the full chain so warm loads skip mip generation
+        result.levels = tex_mip_count(width, height);
+        result.pixels = (byte*)counted_malloc(tex_size(width, height, result.levels));
+        memcpy(result.pixels, pixels, width * height * 4);
+        free(pixels); // stb_image and qoi both use malloc
+
+        tex_generate_mips(result.pixels, width, height, result.levels);
+        save_cached_image(path, &result);
+    }
+
+    return result;
+}
+
+// 4x4 ordered dither thresholds in 16ths
+const byte BAYER_4X4[16] =
+{
+     0,  8,  2, 10,
+    12,  4, 14,  6,
+     3, 11,  1,  9,
+    15,  7, 13,  5
+};
+
+// value to bits with the dither threshold of pixel x, y
+uint dither(const byte value, const uint bits, const uint x, const uint y)
+{
+    uint max = (1 << bits) - 1;
+
+    return (value * max * 16 + BAYER_4X4[(y & 3) * 4 + (x & 3)] * 255) / (255 * 16);
+}
+
+// RGBA into one of the 16 bit formats - malloc'ed
+word* convert_16(const byte* pixels, const uint width, const uint height, const TextureFormat format)
+{
+    word* result = (word*)counted_malloc(width * height * sizeof(word));
+    word* target = result;
+
+    for (uint y = 0; y < height; y++)
+    {
+        for (uint x = 0; x < width; x++, pixels += 4)
+        {
+            uint r = pixels[0], g = pixels[1], b = pixels[2], a = pixels[3];
+
+            if (format == TEXTURE_RGBA4444)
+                *target++ = dither(r, 4, x, y) << 12 | dither(g, 4, x, y) << 8 | dither(b, 4, x, y) << 4 | dither(a, 4, x, y);
+            else if (format == TEXTURE_RGBA5551)
+                *target++ = dither(r, 5, x, y) << 11 | dither(g, 5, x, y) << 6 | dither(b, 5, x, y) << 1 | (a >= 128);
+            else // TEXTURE_RGB565
+                *target++ = dither(r, 5, x, y) << 11 | dither(g, 6, x, y) << 5 | dither(b, 5, x, y);
+        }
+    }
+
+    return result;
+}
+
+// RGBA into one channel - luminance or alpha - malloc'ed
+byte* convert_8(const byte* pixels, const uint width, const uint height, const TextureFormat format)
+{
+    long count = width * height;
+    byte* result = (byte*)counted_malloc(count);
+
+    for (long i = 0; i < count; i++, pixels += 4)
+        result[i] = format == TEXTURE_A8 ?
+            pixels[3] :
+            (pixels[0] * 77 + pixels[1] * 150 + pixels[2] * 29) >> 8;
+
+    return result;
+}
+
+// RGBA into palette indices - malloc'ed - palette gets 256 RGBA entries
+// precision is dropped one bit per channel at a time until 256 colors are enough
+// a channel cut to its top bits back to the full range - the bits repeat
+// downwards, so 0 stays 0 and the top value becomes 255 (opaque stays opaque)
+byte widen_channel(const byte value, const uint bits)
+{
+    uint result = value;
+
+    for (uint shift = bits; shift < 8; shift += bits)
+        result |= value >> shift;
+
+    return result;
+}
+
+byte* convert_indexed(const byte* pixels, const uint width, const uint height, byte* palette)
+{
+    long count = width * height;
+    byte* result = (byte*)counted_malloc(count);
+    uint colors[256];
+    uint used = 0;
+    uint shift;
+
+    for (shift = 0; shift < 8; shift++)
+    {
+        byte mask = 0xff << shift;
+        const byte* source = pixels;
+        uint last = 0;
+        used = 0;
+
+        for (long i = 0; i < count && used <= 256; i++, source += 4)
+        {
+            uint color =
+                (source[0] & mask) | (source[1] & mask) << 8 |
+                (source[2] & mask) << 16 | (uint)(source[3] & mask) << 24;
+            uint index = 0;
+
+            if (i > 0 && color == last)
+                index = result[i - 1]; // runs of the same color are common in sprites
+            else
+            {
+                while (index < used && colors[index] != color)
+                    index++;
+
+                if (index == used)
+                {
+                    if (used == 256)
+                    {
+                        used++; // too many colors - retry with less precision
+                        break;
+                    }
+
+                    colors[used++] = color;
+                }
+            }
+
+            result[i] = index;
+            last = color;
+        }
+
+        if (used <= 256)
+        {
+            if (shift > 0)
+                debug("Palette needed %i bits per channel", 8 - shift);
+            break;
+        }
+    }
+
+    memset(palette, 0, 256 * 4);
+
+    for (uint i = 0; i < used && i < 256; i++)
+    {
+        palette[i * 4 + 0] = widen_channel(colors[i] & 0xff, 8 - shift);
+        palette[i * 4 + 1] = widen_channel((colors[i] >> 8) & 0xff, 8 - shift);
+        palette[i * 4 + 2] = widen_channel((colors[i] >> 16) & 0xff, 8 - shift);
+        palette[i * 4 + 3] = widen_channel(colors[i] >> 24, 8 - shift);
+    }
+
+    return result;
+}
+
+// crops an RGBA image to the bounding box of its non transparent pixels
+// returns the kept part in original pixels - mips are dropped
+Rect trim_image(Image* image)
+{
+    Rect result = { 0, 0, image->width, image->height };
+
+    if (image->format != 0 || image->pixels == NULL)
+        return result;
+
+    uint min_x = image->width, min_y = image->height, max_x = 0, max_y = 0;
+
+    for (uint y = 0; y < image->height; y++)
+    {
+        const byte* row = image->pixels + y * image->width * 4;
+
+        for (uint x = 0; x < image->width; x++)
+        {
+            if (row[x * 4 + 3] == 0)
+                continue;
+
+            if (x < min_x) min_x = x;
+            if (x > max_x) max_x = x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
+        }
+    }
+
+    if (min_x > max_x)
+        return result; // fully transparent - nothing sensible to keep
+
+    result.x = min_x;
+    result.y = min_y;
+    result.width = max_x - min_x + 1;
+    result.height = max_y - min_y + 1;
+
+    if (result.width == image->width && result.height == image->height)
+        return result;
+
+    byte* pixels = (byte*)counted_malloc(result.width * result.height * 4);
+
+    for (uint y = 0; y < result.height; y++)
+        memcpy(
+            pixels + y * result.width * 4,
+            image->pixels + ((result.y + y) * image->width + result.x) * 4,
+            result.width * 4);
+
+    bool premultiplied = image->premultiplied;
+
+    unload_image(image);
+
+    image->width = result.width;
+    image->height = result.height;
+    image->levels = 1;
+    image->pixels = pixels;
+    image->format = 0;
+    image->premultiplied = premultiplied;
+
+    return result;
+}
+
+// convex mesh around the opaque pixels - drawn instead of a quad on sprites
+// with large transparent corners to save fill rate
+
+#define MAX_HULL_VERTICES 16
+
+const float HULL_MIN_SAVING = 0.15f; // mesh has to cover 15% less pixels than the quad
+
+float hull_cross(const Vector o, const Vector a, const Vector b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+int compare_hull_points(const void* a, const void* b)
+{
+    const Vector* p = (const Vector*)a;
+    const Vector* q = (const Vector*)b;
+
+    if (p->x != q->x)
+        return p->x < q->x ? -1 : 1;
+
+    return p->y < q->y ? -1 : (p->y > q->y ? 1 : 0);
+}
+
+float polygon_area(const Vector* points, const int count)
+{
+    float result = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        const Vector a = points[i];
+        const Vector b = points[(i + 1) % count];
+        result += a.x * b.y - b.x * a.y;
+    }
+
+    return fabs(result) / 2.f;
+}
+
+// removes the edge that adds the least area by extending its neighbours until they meet
+// the polygon only grows so it keeps containing every opaque pixel
+bool remove_hull_edge(Vector* points, int* count, const float width, const float height)
+{
+    int n = *count;
+    int best = -1;
+    float best_area = 0;
+    Vector best_point;
+
+    for (int i = 0; i < n; i++)
+    {
+        Vector a = points[(i + n - 1) % n];
+        Vector b = points[i];
+        Vector c = points[(i + 1) % n];
+        Vector d = points[(i + 2) % n];
+
+        Vector ab = { b.x - a.x, b.y - a.y };
+        Vector dc = { c.x - d.x, c.y - d.y };
+        Vector bc = { c.x - b.x, c.y - b.y };
+
+        float denominator = ab.x * dc.y - ab.y * dc.x;
+
+        if (fabs(denominator) < 0.0001f)
+            continue; // parallel - they never meet
+
+        float s = (bc.x * dc.y - bc.y * dc.x) / denominator;
+        float r = (bc.x * ab.y - bc.y * ab.x) / denominator;
+
+        if (s < 0 || r < 0)
+            continue; // they meet behind the edge
+
+        Vector q = { b.x + s * ab.x, b.y + s * ab.y };
+
+        if (q.x < -0.01f || q.y < -0.01f || q.x > width + 0.01f || q.y > height + 0.01f)
+            continue; // outside the image
+
+        float area = fabs(hull_cross(b, q, c)) / 2.f;
+
+        if (best < 0 || area < best_area)
+        {
+            best = i;
+            best_area = area;
+            best_point = q;
+        }
+    }
+
+    if (best < 0)
+        return false;
+
+    // b becomes the meeting point and c goes away
+    points[best] = best_point;
+
+    for (int i = (best + 1) % n; i < n - 1; i++)
+        points[i] = points[i + 1];
+
+    *count = n - 1;
+
+    return true;
+}
+
+// convex hull of the opaque pixels with at most budget vertices, in pixels of the image
+// returns 0 when a quad is cheaper
+int image_hull(const Image* image, const int budget, Vector* result)
+{
+    if (image->format != 0 || image->pixels == NULL || budget < 3)
+        return 0;
+
+    uint width = image->width;
+    uint height = image->height;
+
+    // corners of the leftmost and rightmost opaque pixel of every row
+    long mark = arena_mark(&scratch_arena);
+    Vector* points = (Vector*)arena_alloc(&scratch_arena, height * 4 * sizeof(Vector));
+    Vector* hull = (Vector*)arena_alloc(&scratch_arena, (height * 4 + 1) * sizeof(Vector));
+    int count = 0;
+
+    if (hull == NULL)
+    {
+        arena_restore(&scratch_arena, mark);
+        return 0;
+    }
+
+    for (uint y = 0; y < height; y++)
+    {
+        const byte* row = image->pixels + y * width * 4;
+        int left = -1, right = -1;
+
+        for (uint x = 0; x < width; x++)
+        {
+            if (row[x * 4 + 3] != 0)
+            {
+                if (left < 0)
+                    left = x;
+
+                right = x + 1;
+            }
+        }
+
+        if (left < 0)
+            continue;
+
+        Vector corners[4] = { { left, y }, { left, y + 1 }, { right, y }, { right, y + 1 } };
+        memcpy(points + count, corners, sizeof(corners));
+        count += 4;
+    }
+
+    if (count == 0)
+    {
+        arena_restore(&scratch_arena, mark);
+        return 0;
+    }
+
+    // monotone chain
+    qsort(points, count, sizeof(Vector), compare_hull_points);
+
+    int k = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        while (k >= 2 && hull_cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            k--;
+
+        hull[k++] = points[i];
+    }
+
+    for (int i = count - 2, lower = k + 1; i >= 0; i--)
+    {
+        while (k >= lower && hull_cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            k--;
+
+        hull[k++] = points[i];
+    }
+
+    k--; // last point is the first one
+
+    while (k > budget && remove_hull_edge(hull, &k, width, height));
+
+    int result_count = 0;
+
+    if (k <= budget && k >= 3 &&
+        polygon_area(hull, k) < (1.f - HULL_MIN_SAVING) * width * height)
+    {
+        memcpy(result, hull, k * sizeof(Vector));
+        result_count = k;
+    }
+
+    arena_restore(&scratch_arena, mark);
+
+    return result_count;
+}
+
+//**************************************************
+// OPENGL
+//**************************************************
+
+typedef BOOL (WINAPI * PFNWGLCHOOSEPIXELFORMATARBPROC) (HDC hdc, const int *piAttribIList, const FLOAT *pfAttribFList, UINT nMaxFormats, int *piFormats, UINT *nNumFormats);
+typedef HGLRC (WINAPI * PFNWGLCREATECONTEXTATTRIBSARBPROC) (HDC hDC, HGLRC hShareContext, const int *attribList);
+typedef BOOL (WINAPI * PFNWGLSWAPINTERVALEXTPROC) (int interval);
+typedef void (APIENTRY * PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRY * PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
+typedef void (APIENTRY * PFNGLBINDVERTEXARRAYPROC) (GLuint array);
+typedef void (APIENTRY * PFNGLBUFFERDATAPROC) (GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+typedef void (APIENTRY * PFNGLCOMPILESHADERPROC) (GLuint shader);
+typedef GLuint (APIENTRY * PFNGLCREATEPROGRAMPROC) (void);
+typedef GLuint (APIENTRY * PFNGLCREATESHADERPROC) (GLenum type);
+typedef void (APIENTRY * PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY * PFNGLDELETEPROGRAMPROC) (GLuint program);
+typedef void (APIENTRY * PFNGLDELETESHADERPROC) (GLuint shader);
+typedef void (APIENTRY * PFNGLDELETEVERTEXARRAYSPROC) (GLsizei n, const GLuint *arrays);
+typedef void (APIENTRY * PFNGLDETACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRY * PFNGLENABLEVERTEXATTRIBARRAYPROC) (GLuint index);
+typedef void (APIENTRY * PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
+typedef void (APIENTRY * PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef GLint (APIENTRY * PFNGLGETATTRIBLOCATIONPROC) (GLuint program, const char *name);
+typedef void (APIENTRY * PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, char *infoLog);
+typedef void (APIENTRY * PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
+typedef void (APIENTRY * PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, char *infoLog);
+typedef void (APIENTRY * PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
+typedef void (APIENTRY * PFNGLLINKPROGRAMPROC) (GLuint program);
+typedef void (APIENTRY * PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const char* *string, const GLint *length);
+typedef void (APIENTRY * PFNGLUSEPROGRAMPROC) (GLuint program);
+typedef void (APIENTRY * PFNGLVERTEXATTRIBPOINTERPROC) (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+typedef void (APIENTRY * PFNGLBINDATTRIBLOCATIONPROC) (GLuint program, GLuint index, const char *name);
+typedef GLint (APIENTRY * PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const char *name);
+typedef void (APIENTRY * PFNGLUNIFORMMATRIX4FVPROC) (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+typedef void (APIENTRY * PFNGLACTIVETEXTUREPROC) (GLenum texture);
+typedef void (APIENTRY * PFNGLUNIFORM1IPROC) (GLint location, GLint v0);
+typedef void (APIENTRY * PFNGLGENERATEMIPMAPPROC) (GLenum target);
+typedef void (APIENTRY * PFNGLDISABLEVERTEXATTRIBARRAYPROC) (GLuint index);
+typedef void (APIENTRY * PFNGLUNIFORM1FPROC) (GLint location, GLfloat v0);
+typedef void (APIENTRY * PFNGLUNIFORM2FPROC) (GLint location, GLfloat v0, GLfloat v1);
+typedef void (APIENTRY * PFNGLUNIFORM3FVPROC) (GLint location, GLsizei count, const GLfloat *value);
+typedef void (APIENTRY * PFNGLUNIFORM4FVPROC) (GLint location, GLsizei count, const GLfloat *value);
+typedef void (APIENTRY * PFNGLVEXTEXATTRIB3FPROC) (GLuint index, GLfloat v0, GLfloat v1, GLfloat v2);
+typedef void (APIENTRY * PFNGLUNIFORM4FPROC) (GLuint index, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+typedef void (APIENTRY * PFNGLCOMPRESSEDTEXIMAGE2DPROC) (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data);
+typedef void (APIENTRY * PFNGLTEXIMAGE3DPROC) (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
+typedef void (APIENTRY * PFNGLTEXSUBIMAGE3DPROC) (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels);
+typedef void (APIENTRY * PFNGLGENQUERIESPROC) (GLsizei n, GLuint *ids);
+typedef void (APIENTRY * PFNGLDELETEQUERIESPROC) (GLsizei n, const GLuint *ids);
+typedef void (APIENTRY * PFNGLBEGINQUERYPROC) (GLenum target, GLuint id);
+typedef void (APIENTRY * PFNGLENDQUERYPROC) (GLenum target);
+typedef void (APIENTRY * PFNGLGETQUERYOBJECTIVPROC) (GLuint id, GLenum pname, GLint *params);
+typedef void (APIENTRY * PFNGLGETQUERYOBJECTUI64VPROC) (GLuint id, GLenum pname, unsigned long long *params);
+typedef void (APIENTRY * PFNGLUNIFORM1IVPROC) (GLint location, GLsizei count, const GLint *value);
+typedef void (APIENTRY * PFNGLBINDBUFFERBASEPROC) (GLenum target, GLuint index, GLuint buffer);
+typedef void (APIENTRY * PFNGLDISPATCHCOMPUTEPROC) (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRY * PFNGLMEMORYBARRIERPROC) (GLbitfield barriers);
+
+#define WGL_DRAW_TO_WINDOW_ARB         0x2001
+#define WGL_ACCELERATION_ARB           0x2003
+#define WGL_SWAP_METHOD_ARB            0x2007
+#define WGL_SUPPORT_OPENGL_ARB         0x2010
+#define WGL_DOUBLE_BUFFER_ARB          0x2011
+#define WGL_PIXEL_TYPE_ARB             0x2013
+#define WGL_COLOR_BITS_ARB             0x2014
+#define WGL_DEPTH_BITS_ARB             0x2022
+#define WGL_STENCIL_BITS_ARB           0x2023
+#define WGL_FULL_ACCELERATION_ARB      0x2027
+#define WGL_SWAP_EXCHANGE_ARB          0x2028
+#define WGL_TYPE_RGBA_ARB              0x202B
+#define WGL_CONTEXT_MAJOR_VERSION_ARB  0x2091
+#define WGL_CONTEXT_MINOR_VERSION_ARB  0x2092
+#define WGL_CONTEXT_PROFILE_MASK_ARB   0x9126
+#define WGL_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB 0x0002
+
+#define GL_ARRAY_BUFFER                   0x8892
+#define GL_STATIC_DRAW                    0x88E4
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_INFO_LOG_LENGTH                0x8B84
+#define GL_TEXTURE0                       0x84C0
+#define GL_BGRA                           0x80E1
+#define GL_ELEMENT_ARRAY_BUFFER           0x8893
+#define GL_CLAMP_TO_EDGE                  0x812F
+#define GL_GENERATE_MIPMAP_HINT           0x8192
+#define GL_TEXTURE_MAX_LEVEL              0x813D
+#define GL_TEXTURE1                       0x84C1
+#define GL_UNSIGNED_SHORT_4_4_4_4         0x8033
+#define GL_UNSIGNED_SHORT_5_5_5_1         0x8034
+#define GL_UNSIGNED_SHORT_5_6_5           0x8363
+#define GL_QUERY_RESULT                   0x8866
+#define GL_QUERY_RESULT_AVAILABLE         0x8867
+#define GL_TIME_ELAPSED                   0x88BF
+#define GL_MAX_TEXTURE_IMAGE_UNITS        0x8872
+#define GL_TEXTURE_2D_ARRAY               0x8C1A
+#define GL_VERTEX_PROGRAM_POINT_SIZE      0x8642
+#define GL_POINT_SPRITE                   0x8861
+#define GL_ALIASED_POINT_SIZE_RANGE       0x846D
+#define GL_MAJOR_VERSION                  0x821B
+#define GL_MINOR_VERSION                  0x821C
+#define GL_DYNAMIC_COPY                   0x88EA
+#define GL_COMPUTE_SHADER                 0x91B9
+#define GL_SHADER_STORAGE_BUFFER          0x90D2
+#define GL_SHADER_STORAGE_BARRIER_BIT     0x00002000
+#define GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS 0x90D6
+
+PFNGLUSEPROGRAMPROC glUseProgram;
+PFNGLATTACHSHADERPROC glAttachShader;
+PFNGLBINDBUFFERPROC glBindBuffer;
+PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+PFNGLBUFFERDATAPROC glBufferData;
+PFNGLCOMPILESHADERPROC glCompileShader;
+PFNGLCREATEPROGRAMPROC glCreateProgram;
+PFNGLCREATESHADERPROC glCreateShader;
+PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+PFNGLDELETEPROGRAMPROC glDeleteProgram;
+PFNGLDELETESHADERPROC glDeleteShader;
+PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
+PFNGLDETACHSHADERPROC glDetachShader;
+PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
+PFNGLGENBUFFERSPROC glGenBuffers;
+PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
+PFNGLGETATTRIBLOCATIONPROC glGetAttribLocation;
+PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+PFNGLGETPROGRAMIVPROC glGetProgramiv;
+PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+PFNGLGETSHADERIVPROC glGetShaderiv;
+PFNGLLINKPROGRAMPROC glLinkProgram;
+PFNGLSHADERSOURCEPROC glShaderSource;
+PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
+PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
+PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
+PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
+PFNGLACTIVETEXTUREPROC glActiveTexture;
+PFNGLUNIFORM1IPROC glUniform1i;
+PFNGLGENERATEMIPMAPPROC glGenerateMipmap;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
+PFNGLUNIFORM1FPROC glUniform1f;
+PFNGLUNIFORM2FPROC glUniform2f;
+PFNGLUNIFORM3FVPROC glUniform3fv;
+PFNGLUNIFORM4FVPROC glUniform4fv;
+PFNGLVEXTEXATTRIB3FPROC glVertexAttrib3f;
+PFNGLUNIFORM4FPROC glUniform4f;
+PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D;
+PFNGLTEXIMAGE3DPROC glTexImage3D;
+PFNGLTEXSUBIMAGE3DPROC glTexSubImage3D;
+PFNGLGENQUERIESPROC glGenQueries;
+PFNGLDELETEQUERIESPROC glDeleteQueries;
+PFNGLBEGINQUERYPROC glBeginQuery;
+PFNGLENDQUERYPROC glEndQuery;
+PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
+PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+PFNGLUNIFORM1IVPROC glUniform1iv;
+PFNGLBINDBUFFERBASEPROC glBindBufferBase;
+PFNGLDISPATCHCOMPUTEPROC glDispatchCompute;
+PFNGLMEMORYBARRIERPROC glMemoryBarrier;
+
+PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormatARB;
+PFNWGLCREATECONTEXTATTRIBSARBPROC wglCreateContextAttribsARB;
+PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT;
+
+void load_opengl_extensions()
+{
+	wglChoosePixelFormatARB = (PFNWGLCHOOSEPIXELFORMATARBPROC)wglGetProcAddress("wglChoosePixelFormatARB");
+	wglCreateContextAttribsARB = (PFNWGLCREATECONTEXTATTRIBSARBPROC)wglGetProcAddress("wglCreateContextAttribsARB");
+	wglSwapIntervalEXT = (PFNWGLSWAPINTERVALEXTPROC)wglGetProcAddress("wglSwapIntervalEXT");
+	glAttachShader = (PFNGLATTACHSHADERPROC)wglGetProcAddress("glAttachShader");
+	glBindBuffer = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
+	glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)wglGetProcAddress("glBindVertexArray");
+	glBufferData = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
+	glCompileShader = (PFNGLCOMPILESHADERPROC)wglGetProcAddress("glCompileShader");
+	glCreateProgram = (PFNGLCREATEPROGRAMPROC)wglGetProcAddress("glCreateProgram");
+	glCreateShader = (PFNGLCREATESHADERPROC)wglGetProcAddress("glCreateShader");
+	glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
+	glDeleteProgram = (PFNGLDELETEPROGRAMPROC)wglGetProcAddress("glDeleteProgram");
+	glDeleteShader = (PFNGLDELETESHADERPROC)wglGetProcAddress("glDeleteShader");
+	glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)wglGetProcAddress("glDeleteVertexArrays");
+	glDetachShader = (PFNGLDETACHSHADERPROC)wglGetProcAddress("glDetachShader");
+	glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glEnableVertexAttribArray");
+	glGenBuffers = (PFNGLGENBUFFERSPROC)wglGetProcAddress("glGenBuffers");
+	glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)wglGetProcAddress("glGenVertexArrays");
+	glGetAttribLocation = (PFNGLGETATTRIBLOCATIONPROC)wglGetProcAddress("glGetAttribLocation");
+	glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)wglGetProcAddress("glGetProgramInfoLog");
+	glGetProgramiv = (PFNGLGETPROGRAMIVPROC)wglGetProcAddress("glGetProgramiv");
+	glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)wglGetProcAddress("glGetShaderInfoLog");
+	glGetShaderiv = (PFNGLGETSHADERIVPROC)wglGetProcAddress("glGetShaderiv");
+	glLinkProgram = (PFNGLLINKPROGRAMPROC)wglGetProcAddress("glLinkProgram");
+	glShaderSource = (PFNGLSHADERSOURCEPROC)wglGetProcAddress("glShaderSource");
+	glUseProgram = (PFNGLUSEPROGRAMPROC)wglGetProcAddress("glUseProgram");
+	glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)wglGetProcAddress("glVertexAttribPointer");
+	glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC)wglGetProcAddress("glBindAttribLocation");
+	glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)wglGetProcAddress("glGetUniformLocation");
+	glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVPROC)wglGetProcAddress("glUniformMatrix4fv");
+	glActiveTexture = (PFNGLACTIVETEXTUREPROC)wglGetProcAddress("glActiveTexture");
+	glUniform1i = (PFNGLUNIFORM1IPROC)wglGetProcAddress("glUniform1i");
+	glGenerateMipmap = (PFNGLGENERATEMIPMAPPROC)wglGetProcAddress("glGenerateMipmap");
+	glDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glDisableVertexAttribArray");
+	glUniform1f = (PFNGLUNIFORM1FPROC)wglGetProcAddress("glUniform1f");
+	glUniform2f = (PFNGLUNIFORM2FPROC)wglGetProcAddress("glUniform2f");
+	glUniform3fv = (PFNGLUNIFORM3FVPROC)wglGetProcAddress("glUniform3fv");
+	glUniform4fv = (PFNGLUNIFORM4FVPROC)wglGetProcAddress("glUniform4fv");
+	glVertexAttrib3f = (PFNGLVEXTEXATTRIB3FPROC)wglGetProcAddress("glVertexAttrib3f");
+	glUniform4f = (PFNGLUNIFORM4FPROC)wglGetProcAddress("glUniform4f");
+	glCompressedTexImage2D = (PFNGLCOMPRESSEDTEXIMAGE2DPROC)wglGetProcAddress("glCompressedTexImage2D");
+	glTexImage3D = (PFNGLTEXIMAGE3DPROC)wglGetProcAddress("glTexImage3D");
+	glTexSubImage3D = (PFNGLTEXSUBIMAGE3DPROC)wglGetProcAddress("glTexSubImage3D");
+	glGenQueries = (PFNGLGENQUERIESPROC)wglGetProcAddress("glGenQueries");
+	glDeleteQueries = (PFNGLDELETEQUERIESPROC)wglGetProcAddress("glDeleteQueries");
+	glBeginQuery = (PFNGLBEGINQUERYPROC)wglGetProcAddress("glBeginQuery");
+	glEndQuery = (PFNGLENDQUERYPROC)wglGetProcAddress("glEndQuery");
+	glGetQueryObjectiv = (PFNGLGETQUERYOBJECTIVPROC)wglGetProcAddress("glGetQueryObjectiv");
+	glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)wglGetProcAddress("glGetQueryObjectui64v");
+	glUniform1iv = (PFNGLUNIFORM1IVPROC)wglGetProcAddress("glUniform1iv");
+	glBindBufferBase = (PFNGLBINDBUFFERBASEPROC)wglGetProcAddress("glBindBufferBase");
+	glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)wglGetProcAddress("glDispatchCompute");
+	glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)wglGetProcAddress("glMemoryBarrier");
+
+	if (glGetQueryObjectui64v == NULL) // EXT_timer_query
+		glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)wglGetProcAddress("glGetQueryObjectui64vEXT");
+}
+
+// pixel art never samples mips - filtering and mips default from PIXEL_ART
+TextureOptions texture_options()
+{
+    TextureOptions result;
+
+    result.nearest = PIXEL_ART;
+    result.mipmaps = ! PIXEL_ART;
+    result.repeat = false;
+    result.trim = false;
+    result.hull = 0;
+    result.format = TEXTURE_RGBA;
+
+    return result;
+}
+
+bool same_options(const TextureOptions a, const TextureOptions b)
+{
+    return a.nearest == b.nearest && a.mipmaps == b.mipmaps &&
+        a.repeat == b.repeat && a.trim == b.trim && a.hull == b.hull && a.format == b.format;
+}
+
+uint format_bytes(const TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_RGBA: return 4;
+    case TEXTURE_RGB: return 3;
+    case TEXTURE_RGBA4444:
+    case TEXTURE_RGBA5551:
+    case TEXTURE_RGB565: return 2;
+    case TEXTURE_L8:
+    case TEXTURE_A8:
+    case TEXTURE_INDEXED: return 1;
+    }
+
+    return 4;
+}
+
+// levels on the gpu for an image with these options
+uint texture_levels(const Image* image, const TextureOptions options)
+{
+    if (! options.mipmaps)
+        return 1;
+
+    if (image->format != 0)
+        return image->levels; // compressed mips can only come from the file
+
+    return tex_mip_count(image->width, image->height);
+}
+
+// VRAM used by the first levels of an image with these options
+long texture_bytes(const Image* image, const uint levels, const TextureOptions options)
+{
+    if (image->format == 0)
+        return tex_size(image->width, image->height, levels) / 4 * format_bytes(options.format);
+
+    long result = 0;
+    uint width = image->width;
+    uint height = image->height;
+
+    for (uint i = 0; i < levels; i++)
+    {
+        result += dds_level_size(width, height, dds_block_bytes(image->format));
+
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return result;
+}
+
+// one RGBA level converted to format
+void upload_pixels(const uint level, const uint width, const uint height, const byte* pixels, const TextureFormat format)
+{
+    GLint internal_format = GL_RGBA;
+    GLenum data_format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    void* data = (void*)pixels;
+
+    switch (format)
+    {
+    case TEXTURE_RGBA:
+    case TEXTURE_INDEXED: // uploaded by upload_indexed, never here
+        break;
+
+    case TEXTURE_RGB:
+        internal_format = GL_RGB;
+        break;
+
+    case TEXTURE_RGBA4444:
+        internal_format = GL_RGBA4;
+        type = GL_UNSIGNED_SHORT_4_4_4_4;
+        data = convert_16(pixels, width, height, format);
+        break;
+
+    case TEXTURE_RGBA5551:
+        internal_format = GL_RGB5_A1;
+        type = GL_UNSIGNED_SHORT_5_5_5_1;
+        data = convert_16(pixels, width, height, format);
+        break;
+
+    case TEXTURE_RGB565:
+        internal_format = GL_RGB5;
+        data_format = GL_RGB;
+        type = GL_UNSIGNED_SHORT_5_6_5;
+        data = convert_16(pixels, width, height, format);
+        break;
+
+    case TEXTURE_L8:
+        internal_format = GL_LUMINANCE8;
+        data_format = GL_LUMINANCE;
+        data = convert_8(pixels, width, height, format);
+        break;
+
+    case TEXTURE_A8:
+        internal_format = GL_ALPHA8;
+        data_format = GL_ALPHA;
+        data = convert_8(pixels, width, height, format);
+        break;
+    }
+
+    glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, data_format, type, data);
+    current_stats.bytes_uploaded += width * height * format_bytes(format);
+
+    if (data != pixels)
+        free(data);
+}
+
+// indices go to the bound texture and the colors to a 256x1 palette texture
+void upload_indexed(const Image* image, GLuint id, GLuint* palette)
+{
+    byte colors[256 * 4];
+    byte* indices = convert_indexed(image->pixels, image->width, image->height, colors);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, image->width, image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, indices);
+    free(indices);
+
+    if (*palette == 0)
+        glGenTextures(1, palette);
+
+    glBindTexture(GL_TEXTURE_2D, *palette);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, colors);
+    current_stats.bytes_uploaded += image->width * image->height + 256 * 4;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, id);
+}
+
+// uploads into id or into a new texture when id is 0
+// mips come from the image when it has them (.tex files and the texture cache)
+// palette is only used by TEXTURE_INDEXED
+uint upload_image(const Image* image, GLuint id, const TextureOptions options, GLuint* palette)
+{
+    glBindTexture(GL_TEXTURE_2D, 0); // Free any old binding
+
+    if (id == 0)
+        glGenTextures(1, &id); // Generate Pointer to the texture
+
+    glBindTexture(GL_TEXTURE_2D, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // 8 and 16 bit rows aren't 4 byte aligned
+
+    uint levels = texture_levels(image, options);
+    uint uploaded = image->levels < levels ? image->levels : levels;
+    byte* level_pixels = image->pixels;
+    uint level_width = image->width;
+    uint level_height = image->height;
+
+    for (uint level = 0; level < uploaded; level++)
+    {
+        if (image->format != 0)
+        {
+            long size = dds_level_size(level_width, level_height, dds_block_bytes(image->format));
+
+            glCompressedTexImage2D(
+                GL_TEXTURE_2D,
+                level,
+                image->format,
+                level_width,
+                level_height,
+                0,
+                size,
+                level_pixels);
+
+            level_pixels += size;
+            current_stats.bytes_uploaded += size;
+        }
+        else if (options.format == TEXTURE_INDEXED)
+        {
+            upload_indexed(image, id, palette);
+        }
+        else
+        {
+            upload_pixels(level, level_width, level_height, level_pixels, options.format);
+
+            level_pixels += level_width * level_height * 4;
+        }
+
+        level_width = level_width > 1 ? level_width / 2 : 1;
+        level_height = level_height > 1 ? level_height / 2 : 1;
+    }
+
+    if (uploaded < levels)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    GLint wrap = options.repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    GLint mag_filter = options.nearest ? GL_NEAREST : GL_LINEAR;
+    GLint min_filter = mag_filter;
+
+    if (levels > 1)
+        min_filter = options.nearest ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+
+    // Unbind current texture
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return id;
+}
+
+//**************************************************
+// TEXTURE REGISTRY
+//**************************************************
+
+// every loaded image is uploaded once and shared - load_texture on the same
+// path returns the same gl texture and unload_texture only frees it when
+// the last reference goes away
+
+// with a TEXTURE_BUDGET the least recently drawn textures get their storage
+// released when over budget - the gl id is kept so every Texture copy stays
+// valid and the image is reloaded (from the texture cache if enabled) when
+// drawn again
+
+#define MAX_TEXTURES 256 // a power of 2 up to 256 - the slot is the low byte of a handle
+#define TEXTURE_SLOT_BITS 8
+
+typedef word TextureHandle; // registry slot and its generation - see texture_handle - 0 is no texture
+
+typedef struct TextureEntry
+{
+    char path[MAX_PATH];
+    uint id;
+    uint width;
+    uint height;
+    TextureOptions options;
+    uint references;
+    uint levels; // on the gpu
+    uint palette; // gl id of the palette for TEXTURE_INDEXED
+    Rect trim; // part of the image on the gpu - all of it unless trimmed
+    Vector hull[MAX_HULL_VERTICES]; // mesh in image pixels
+    int hull_count; // 0 draws a quad
+    long bytes; // VRAM used including mips
+    bool resident; // false when evicted by the budget
+    bool failed; // the reload after an eviction failed - retried when acquired again
+    uint last_used; // frame number of the last draw
+    TextureHandle array; // first layer when its texture array was made - 0 for 2d textures
+    byte layer;
+    byte generation; // goes up every time the slot is freed - see texture_handle
+} TextureEntry;
+
+TextureEntry texture_registry[MAX_TEXTURES];
+bool texture_arrays; // supported - set by load_texture_arrays
+uint frame_number;
+long trimmed_pixels; // transparent pixels not uploaded nor drawn
+
+int texture_slot(const TextureHandle handle)
+{
+    return handle & (MAX_TEXTURES - 1);
+}
+
+// the slot with its generation on the high byte - never 0 so no handle is 0
+// copies kept after the last release go stale instead of reaching the next
+// texture loaded on the same slot
+TextureHandle texture_handle(const int slot)
+{
+    return (texture_registry[slot].generation % 0xFF + 1) << TEXTURE_SLOT_BITS | slot;
+}
+
+// NULL for 0, released or stale handles
+TextureEntry* texture_entry(const TextureHandle handle)
+{
+    int slot = texture_slot(handle);
+
+    if (handle == 0 || texture_handle(slot) != handle || texture_registry[slot].references == 0)
+        return NULL;
+
+    return &texture_registry[slot];
+}
+
+TextureHandle find_texture(const string filename, const TextureOptions options)
+{
+    for (int i = 0; i < MAX_TEXTURES; i++)
+        if (texture_registry[i].references > 0 &&
+            texture_registry[i].array == 0 && // layers are only shared through their handles
+            _stricmp(texture_registry[i].path, filename) == 0 &&
+            same_options(texture_registry[i].options, options))
+            return texture_handle(i);
+
+    return 0;
+}
+
+TextureHandle find_texture_id(const uint id)
+{
+    for (int i = 0; i < MAX_TEXTURES; i++)
+        if (texture_registry[i].references > 0 && texture_registry[i].id == id)
+            return texture_handle(i);
+
+    return 0;
+}
+
+long textures_vram()
+{
+    long result = 0;
+
+    for (int i = 0; i < MAX_TEXTURES; i++)
+        if (texture_registry[i].references > 0 && texture_registry[i].resident)
+            result += texture_registry[i].bytes;
+
+    return result;
+}
+
+int textures_alive()
+{
+    int result = 0;
+
+    for (int i = 0; i < MAX_TEXTURES; i++)
+        if (texture_registry[i].references > 0)
+            result++;
+
+    return result;
+}
+
+// releases the storage but keeps the gl id
+void evict_texture(TextureEntry* entry)
+{
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+
+    for (uint level = 0; level < entry->levels; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    entry->resident = false;
+
+    debug("[TEX ID %i] Evicted %s (%li bytes)", entry->id, entry->path, entry->bytes);
+}
+
+// evicts least recently drawn textures until under budget - keep and the ones drawn this frame stay
+void enforce_texture_budget(const TextureHandle keep)
+{
+    if (TEXTURE_BUDGET <= 0)
+        return;
+
+    long used = textures_vram();
+
+    while (used > TEXTURE_BUDGET)
+    {
+        TextureEntry* oldest = NULL;
+
+        for (int i = 0; i < MAX_TEXTURES; i++)
+        {
+            TextureEntry* entry = &texture_registry[i];
+
+            if (entry->references == 0 || ! entry->resident || entry->array != 0 ||
+                texture_handle(i) == keep || entry->last_used == frame_number)
+                continue;
+
+            if (oldest == NULL || entry->last_used < oldest->last_used)
+                oldest = entry;
+        }
+
+        if (oldest == NULL)
+        {
+            debug("Texture budget exceeded by %li bytes - nothing left to evict", used - TEXTURE_BUDGET);
+            return;
+        }
+
+        evict_texture(oldest);
+        used -= oldest->bytes;
+    }
+}
+
+void reload_texture(const TextureHandle handle)
+{
+    TextureEntry* entry = &texture_registry[texture_slot(handle)];
+    Image image = load_image(entry->path);
+
+    if (image.pixels == NULL)
+    {
+        debug("[TEX ID %i] Can't reload %s - drawn without pixels until acquired again", entry->id, entry->path);
+        entry->failed = true;
+        return;
+    }
+
+    if (entry->options.trim)
+        trim_image(&image);
+
+    upload_image(&image, entry->id, entry->options, &entry->palette);
+    unload_image(&image);
+
+    entry->resident = true;
+
+    debug("[TEX ID %i] Reloaded %s", entry->id, entry->path);
+
+    enforce_texture_budget(handle);
+}
+
+// marks the texture as used this frame - reloads it if evicted
+void touch_texture(const TextureHandle handle)
+{
+    TextureEntry* entry = texture_entry(handle);
+
+    if (entry == NULL)
+        return;
+
+    entry->last_used = frame_number;
+
+    if (! entry->resident && ! entry->failed)
+        reload_texture(handle);
+}
+
+TextureHandle acquire_texture_options(const string filename, TextureOptions options)
+{
+    if (options.format == TEXTURE_INDEXED)
+    {
+        // filtering or mipmapping indices would mix unrelated colors
+        options.nearest = true;
+        options.mipmaps = false;
+    }
+
+    TextureHandle handle = find_texture(filename, options);
+
+    if (handle != 0)
+    {
+        TextureEntry* entry = texture_entry(handle);
+
+        entry->references++;
+        entry->failed = false;
+        return handle;
+    }
+
+    for (int i = 0; i < MAX_TEXTURES && handle == 0; i++)
+        if (texture_registry[i].references == 0)
+            handle = texture_handle(i);
+
+    if (handle == 0)
+    {
+        debug("Texture registry full, can't load %s", filename);
+        return 0;
+    }
+
+    Image image = load_image(filename);
+
+    if (image.pixels == NULL)
+        return 0;
+
+    TextureEntry* entry = &texture_registry[texture_slot(handle)];
+
+    entry->width = image.width;
+    entry->height = image.height;
+    entry->trim.x = entry->trim.y = 0;
+    entry->trim.width = image.width;
+    entry->trim.height = image.height;
+
+    if (options.trim)
+    {
+        entry->trim = trim_image(&image);
+
+        long saved = entry->width * entry->height - entry->trim.width * entry->trim.height;
+        trimmed_pixels += saved;
+
+        debug("Trimmed %s %ix%i -> %ix%i - %li pixels saved", filename,
+            entry->width, entry->height, entry->trim.width, entry->trim.height, saved);
+    }
+
+    entry->hull_count = image_hull(&image, options.hull < MAX_HULL_VERTICES ? options.hull : MAX_HULL_VERTICES, entry->hull);
+
+    for (int i = 0; i < entry->hull_count; i++)
+    {
+        entry->hull[i].x += entry->trim.x;
+        entry->hull[i].y += entry->trim.y;
+    }
+
+    if (entry->hull_count > 0)
+        debug("Hull of %s - %i vertices covering %.0f%% of the quad", filename, entry->hull_count,
+            100.f * polygon_area(entry->hull, entry->hull_count) / (entry->width * entry->height));
+
+    strncpy(entry->path, filename, MAX_PATH - 1);
+    entry->path[MAX_PATH - 1] = 0;
+    entry->palette = 0;
+    entry->array = 0;
+    entry->layer = 0;
+    entry->id = upload_image(&image, 0, options, &entry->palette);
+    entry->options = options;
+    entry->references = 1;
+    entry->levels = texture_levels(&image, options);
+    entry->bytes = texture_bytes(&image, entry->levels, options);
+
+    if (entry->palette != 0)
+        entry->bytes += 256 * 4;
+    entry->resident = true;
+    entry->failed = false;
+    entry->last_used = frame_number;
+
+    unload_image(&image);
+
+    enforce_texture_budget(handle);
+
+    debug("[TEX ID %i] Loaded %s %ix%i (%li bytes)", entry->id, filename, entry->width, entry->height, entry->bytes);
+
+    return handle;
+}
+
+TextureHandle acquire_texture(const string filename)
+{
+    return acquire_texture_options(filename, texture_options());
+}
+
+// true when no other layer of the texture array is loaded - layers are
+// matched on the gl id they share, since the slot of the first layer can
+// be reused by another array once that layer is released
+bool last_array_layer(const TextureEntry* entry)
+{
+    for (int i = 0; i < MAX_TEXTURES; i++)
+        if (texture_registry[i].references > 0 && texture_registry[i].array != 0 &&
+            texture_registry[i].id == entry->id && &texture_registry[i] != entry)
+            return false;
+
+    return true;
+}
+
+// same sized images as the layers of one GL_TEXTURE_2D_ARRAY - every layer
+// gets its own handle on layers and sprites of any of them batch together
+// returns the layers loaded - 0 without array support or when sizes differ
+int acquire_texture_array(const string* filenames, const int count, TextureOptions options, TextureHandle* layers)
+{
+    if (! texture_arrays)
+    {
+        debug("Texture arrays not supported - can't load %s", filenames[0]);
+        return 0;
+    }
+
+    options.trim = false; // layers keep their size
+    options.format = TEXTURE_RGBA;
+
+    int found = 0;
+
+    for (int i = 0; i < MAX_TEXTURES && found < count; i++)
+        if (texture_registry[i].references == 0)
+            layers[found++] = texture_handle(i);
+
+    if (count > 256 || found < count)
+    {
+        debug("Texture registry full, can't load the array of %s", filenames[0]);
+        return 0;
+    }
+
+    Image* images = (Image*)counted_malloc(count * sizeof(Image));
+    int loaded = 0;
+    bool valid = true;
+
+    for (; loaded < count && valid; loaded++)
+    {
+        images[loaded] = load_image(filenames[loaded]);
+
+        valid = images[loaded].pixels != NULL && images[loaded].format == 0 &&
+            images[loaded].width == images[0].width && images[loaded].height == images[0].height;
+
+        if (! valid)
+            debug("Texture array layers must be same sized RGBA images - %s isn't", filenames[loaded]);
+    }
+
+    GLuint id = 0;
+    uint levels = texture_levels(&images[0], options);
+    uint uploaded = levels;
+
+    if (valid)
+    {
+        for (int i = 0; i < count; i++)
+            if (images[i].levels < uploaded)
+                uploaded = images[i].levels;
+
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        uint width = images[0].width;
+        uint height = images[0].height;
+        long offset = 0;
+
+        for (uint level = 0; level < levels; level++)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, width, height, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+            // mips the images already have - the rest get generated
+            for (int i = 0; i < count && level < uploaded; i++)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, images[i].pixels + offset);
+                current_stats.bytes_uploaded += width * height * 4;
+            }
+
+            offset += width * height * 4;
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+
+        if (uploaded < levels)
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        GLint mag_filter = options.nearest ? GL_NEAREST : GL_LINEAR;
+        GLint min_filter = mag_filter;
+
+        if (levels > 1)
+            min_filter = options.nearest ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, options.repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, options.repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, mag_filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, min_filter);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    for (int i = 0; i < count && id != 0; i++)
+    {
+        TextureEntry* entry = &texture_registry[texture_slot(layers[i])];
+
+        strncpy(entry->path, filenames[i], MAX_PATH - 1);
+        entry->path[MAX_PATH - 1] = 0;
+        entry->id = id;
+        entry->array = layers[0];
+        entry->layer = i;
+        entry->width = images[i].width;
+        entry->height = images[i].height;
+        entry->trim.x = entry->trim.y = 0;
+        entry->trim.width = images[i].width;
+        entry->trim.height = images[i].height;
+        entry->hull_count = image_hull(&images[i], options.hull < MAX_HULL_VERTICES ? options.hull : MAX_HULL_VERTICES, entry->hull);
+        entry->palette = 0;
+        entry->options = options;
+        entry->references = 1;
+        entry->levels = levels;
+        entry->bytes = texture_bytes(&images[i], levels, options);
+        entry->resident = true;
+        entry->failed = false;
+        entry->last_used = frame_number;
+    }
+
+    for (int i = 0; i < loaded; i++)
+        if (images[i].pixels != NULL)
+            unload_image(&images[i]);
+
+    free(images);
+
+    if (id == 0)
+        return 0;
+
+    debug("[TEX ID %i] Texture array of %i layers %ix%i (%li bytes) - one texture instead of %i",
+        id, count, texture_registry[texture_slot(layers[0])].width, texture_registry[texture_slot(layers[0])].height,
+        texture_registry[texture_slot(layers[0])].bytes * count, count);
+
+    enforce_texture_budget(layers[0]);
+
+    return count;
+}
+
+int load_texture_array(const string* filenames, const int count, TextureHandle* layers)
+{
+    return acquire_texture_array(filenames, count, texture_options(), layers);
+}
+
+void flush_sprites(); // RENDERING
+
+void release_texture(const TextureHandle handle)
+{
+    TextureEntry* entry = texture_entry(handle);
+
+    if (entry == NULL)
+        return;
+
+    entry->references--;
+
+    if (entry->references == 0)
+    {
+        flush_sprites(); // might still be waiting on the batch
+
+        if (entry->array == 0 || last_array_layer(entry))
+            glDeleteTextures(1, &entry->id);
+
+        if (entry->palette != 0)
+            glDeleteTextures(1, &entry->palette);
+
+        debug("[TEX ID %i] Unloaded texture data from VRAM (GPU)", entry->id);
+        entry->id = 0;
+        entry->generation++; // handles to it go stale
+    }
+}
+
+Texture texture_from_handle(const TextureHandle handle)
+{
+    TextureEntry* entry = texture_entry(handle);
+    Texture result;
+
+    result.id = entry != NULL ? entry->id : 0;
+    result.handle = entry != NULL ? handle : 0;
+    result.position = VZero;
+    result.pivot = VZero;
+    result.width = entry != NULL ? entry->width : 0;
+    result.height = entry != NULL ? entry->height : 0;
+    result.alpha = 255;
+    result.shadow = 0;
+    result.rotation = 0;
+    result.visible = true;
+    result.flip_x = false;
+    result.flip_y = false;
+    result.scale = 1.0f;
+    result.source.x = 0;
+    result.source.y = 0;
+    result.source.width = result.width;
+    result.source.height = result.height;
+
+    return result;
+}
+
+// sprite of the whole image - copies of it share the texture
+Sprite sprite_from_handle(const TextureHandle handle)
+{
+    TextureEntry* entry = texture_entry(handle);
+    Sprite result;
+
+    result.position = VZero;
+    result.scale = 1.0f;
+    result.rotation = 0;
+    result.source.x = 0;
+    result.source.y = 0;
+    result.source.width = entry != NULL ? entry->width : 0;
+    result.source.height = entry != NULL ? entry->height : 0;
+    result.pivot_x = 0;
+    result.pivot_y = 0;
+    result.image = entry != NULL ? handle : 0;
+    result.shadow = 0;
+    result.color.r = 255;
+    result.color.g = 255;
+    result.color.b = 255;
+    result.color.a = 255;
+    result.flags = SPRITE_VISIBLE;
+
+    return result;
+}
+
+void log_textures()
+{
+    int count = 0;
+
+    for (int i = 0; i < MAX_TEXTURES; i++)
+    {
+        TextureEntry* entry = &texture_registry[i];
+
+        if (entry->references == 0)
+            continue;
+
+        debug("[TEX ID %i] %s %ix%i refs %i - %li bytes%s", entry->id, entry->path, entry->width, entry->height, entry->references, entry->bytes, entry->resident ? "" : " (evicted)");
+        count++;
+    }
+
+    debug("%i textures alive - %li bytes of VRAM resident - %li pixels trimmed", count, textures_vram(), trimmed_pixels);
+}
+
+Texture load_texture(string filename)
+{
+    return texture_from_handle(acquire_texture(filename));
+}
+
+Texture load_texture_options(string filename, const TextureOptions options)
+{
+    return texture_from_handle(acquire_texture_options(filename, options));
+}
+
+// copies of the same texture share the gl id - any of them can unload it
+void unload_texture(Texture texture)
+{
+    if (texture.id != 0)
+		release_texture(texture.handle != 0 ? texture.handle : find_texture_id(texture.id));
+}
+
+Sprite load_sprite(string filename)
+{
+    return sprite_from_handle(acquire_texture(filename));
+}
+
+Sprite load_sprite_options(string filename, const TextureOptions options)
+{
+    return sprite_from_handle(acquire_texture_options(filename, options));
+}
+
+// one release per load_sprite - other sprites of the image stay valid until then
+void unload_sprite(const Sprite* sprite)
+{
+    release_texture(sprite->image);
+}
+
+//**************************************************
+// SHADERS
+//**************************************************
+
+word load_shader_program(const string vertex_str, const string fragment_str)
+{   
+    word program = 0;
+    int maxLength = 0;
+    int length;
+    char msg[1024];
+
+    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vertex_shader, 1, &vertex_str, 0);
+    glShaderSource(fragment_shader, 1, &fragment_str, 0);
+
+    GLint success = 0;
+
+    glCompileShader(vertex_shader);
+
+    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
+
+    if (success != GL_TRUE)
+    {
+        debug("[VSHDR ID %i] Failed to compile vertex shader...", vertex_shader);
+
+        glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &maxLength);        
+
+        glGetShaderInfoLog(vertex_shader, maxLength, &length, msg);
+
+        debug("%s", msg);
+    }
+    else
+    {
+        debug("[VSHDR ID %i] Vertex shader compiled successfully", vertex_shader);
+    }
+
+    glCompileShader(fragment_shader);
+
+    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
+
+    if (success != GL_TRUE)
+    {
+        debug("[FSHDR ID %i] Failed to compile fragment shader...", fragment_shader);
+
+        glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &maxLength);
+        glGetShaderInfoLog(fragment_shader, maxLength, &length, msg);
+
+        debug("%s", msg);
+
+    }
+    else debug("[FSHDR ID %i] Fragment shader compiled successfully", fragment_shader);
+
+    program = glCreateProgram();
+    current_stats.shader_compiles++;
+
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+
+    glLinkProgram(program);
+
+    // NOTE: All uniform variables are initialized to 0 when a program links
+
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (success != GL_TRUE)
+    {
+        debug("[SHDR ID %i] Failed to link shader program...", program);
+
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+        glGetProgramInfoLog(program, maxLength, &length, msg);
+
+        debug("%s", msg);
+
+        glDeleteProgram(program);
+
+        program = 0;
+    }
+    else debug("[SHDR ID %i] Shader program loaded successfully", program);
+
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    return program;
+}
+
+Shader load_shader_verbose(const string vs, const string fs)
+{
+    Shader result;
+
+    result.id = load_shader_program(vs, fs);
+
+    if (result.id != 0)
+    {
+        result.vertex_position = glGetAttribLocation(result.id, "vertex_position");
+        result.texture_position = glGetAttribLocation(result.id, "texture_position");
+        result.vertex_color = glGetAttribLocation(result.id, "vertex_color");
+        result.texture_slot = glGetAttribLocation(result.id, "texture_slot");
+        
+        debug("[SHDR ID %i] shader locations set", result.id);
+    }
+    
+    return result;
+}
+
+Shader load_shader(const string vs_filename, const string fs_filename)
+{
+    string vertex_str = load_text(vs_filename);
+    string fragment_str = load_text(fs_filename);
+
+    Shader result = load_shader_verbose(vertex_str, fragment_str);
+
+    free(vertex_str);
+    free(fragment_str);
+
+    return result;
+}
+
+// fragment shader with a texel() picking one of slots samplers - glsl 100
+// only indexes sampler arrays with constants so it is an if chain
+Shader load_multi_texture_shader(const int slots, const string main)
+{
+    char source[4096];
+    int length = snprintf(source, sizeof(source),
+        "#version 100\n"
+        "precision mediump float;\n"
+        "varying vec2 texture_coordinate;\n"
+        "varying vec4 tint;\n"
+        "varying float slot;\n"
+        "uniform sampler2D textures[%i];\n"
+        "uniform vec4 color;\n"
+        "vec4 texel()\n{\n", slots);
+
+    for (int i = 0; i < slots - 1; i++)
+        length += snprintf(source + length, sizeof(source) - length,
+            "if (slot < %i.5) return texture2D(textures[%i], texture_coordinate);\n", i, i);
+
+    snprintf(source + length, sizeof(source) - length,
+        "return texture2D(textures[%i], texture_coordinate);\n}\n%s", slots - 1, main);
+
+    Shader result = load_shader_verbose(direct_vs, source);
+
+    glUseProgram(result.id);
+
+    for (int i = 0; i < slots; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "textures[%i]", i);
+        glUniform1i(glGetUniformLocation(result.id, name), i);
+    }
+
+    glUseProgram(0);
+
+    return result;
+}
+
+#define MAX_TEXTURE_SLOTS 16
+
+int texture_slots; // multi_shader samplers - 0 without it
+
+void load_multi_texture()
+{
+    GLint units = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+
+    texture_slots = units < MAX_TEXTURE_SLOTS ? units : MAX_TEXTURE_SLOTS;
+
+    if (texture_slots > 1)
+        multi_shader = load_multi_texture_shader(texture_slots, multi_main);
+
+    if (multi_shader.id == 0)
+        texture_slots = 0;
+
+    debug("%i texture slots per batch (%i units)", texture_slots, units);
+}
+
+void load_texture_arrays()
+{
+    texture_arrays = glTexImage3D != NULL && glTexSubImage3D != NULL && has_gl_extension("GL_EXT_texture_array");
+
+    if (texture_arrays)
+        array_shader = load_shader_verbose(array_vs, array_fs);
+
+    texture_arrays = array_shader.id != 0;
+
+    debug("Texture arrays %s", texture_arrays ? "supported" : "not supported");
+}
+
+void unload_shader(Shader shader)
+{
+    glUseProgram(0);
+    glDeleteProgram(shader.id);
+
+    shader.id = 0;
+}
+
+//**************************************************
+// GPU TIMERS
+//**************************************************
+
+// gpu time of every pass with GL_TIME_ELAPSED queries - each frame uses its
+// own set and reads the one from GPU_TIMER_FRAMES - 1 frames ago, which is
+// done by then, so the cpu never waits on the gpu
+// without ARB/EXT_timer_query the gpu times stay at 0
+
+#define GPU_TIMER_FRAMES 3
+
+bool gpu_timers; // supported
+GLuint gpu_queries[GPU_TIMER_FRAMES][GPU_PASSES];
+bool gpu_query_pending[GPU_TIMER_FRAMES][GPU_PASSES];
+float gpu_ms[GPU_PASSES]; // last results
+int gpu_pass = -1; // running - queries of the same kind can't nest
+
+void load_gpu_timers()
+{
+    gpu_timers = glGenQueries != NULL && glGetQueryObjectui64v != NULL &&
+        (has_gl_extension("GL_ARB_timer_query") || has_gl_extension("GL_EXT_timer_query"));
+
+    if (! gpu_timers)
+    {
+        debug("GPU timer queries not supported - gpu times stay at 0");
+        return;
+    }
+
+    glGenQueries(GPU_TIMER_FRAMES * GPU_PASSES, &gpu_queries[0][0]);
+}
+
+void unload_gpu_timers()
+{
+    if (gpu_timers)
+        glDeleteQueries(GPU_TIMER_FRAMES * GPU_PASSES, &gpu_queries[0][0]);
+}
+
+void end_gpu_pass()
+{
+    if (gpu_pass < 0)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    gpu_pass = -1;
+}
+
+// ends the running pass and starts timing the next one
+void begin_gpu_pass(const int pass)
+{
+    if (! gpu_timers)
+        return;
+
+    end_gpu_pass();
+
+    int slot = frame_number % GPU_TIMER_FRAMES;
+
+    glBeginQuery(GL_TIME_ELAPSED, gpu_queries[slot][pass]);
+    gpu_query_pending[slot][pass] = true;
+    gpu_pass = pass;
+}
+
+// after the last pass of the frame - collects the oldest set into current_stats
+void read_gpu_timers()
+{
+    if (gpu_timers)
+    {
+        end_gpu_pass();
+
+        int slot = (frame_number + 1) % GPU_TIMER_FRAMES; // the next frame reuses it
+
+        for (int pass = 0; pass < GPU_PASSES; pass++)
+        {
+            if (! gpu_query_pending[slot][pass])
+            {
+                gpu_ms[pass] = 0; // pass not run that frame
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(gpu_queries[slot][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (! available)
+                continue; // gpu more than two frames behind - keep the old value
+
+            unsigned long long elapsed = 0; // ns
+            glGetQueryObjectui64v(gpu_queries[slot][pass], GL_QUERY_RESULT, &elapsed);
+
+            gpu_ms[pass] = elapsed / 1000000.f;
+            gpu_query_pending[slot][pass] = false;
+        }
+    }
+
+    memcpy(current_stats.gpu_ms, gpu_ms, sizeof(gpu_ms));
+}
+
+//**************************************************
+// DEBUG VIEWS
+//**************************************************
+
+// with DEBUG on F1 cycles through them
+// overdraw - every quad adds 1 to its pixels, shown as a heatmap
+// batches - every draw call gets its own tint
+// quads - outline of every sprite quad
+
+#define DEBUG_VIEW_NONE 0
+#define DEBUG_VIEW_OVERDRAW 1
+#define DEBUG_VIEW_BATCHES 2
+#define DEBUG_VIEW_QUADS 3
+#define DEBUG_VIEW_COUNT 4
+
+const string solid_fs = "#version 100
+precision mediump float;
+uniform vec4 color;
+void main()
+{
+gl_FragColor = color;
+}";
+
+const string tint_fs = "#version 100
+precision mediump float;
+varying vec2 texture_coordinate;
+varying vec4 tint;
+uniform sampler2D texture0;
+uniform vec4 color;
+void main()
+{
+vec4 texel = texture2D(texture0, texture_coordinate);
+gl_FragColor = vec4(mix(texel.rgb, color.rgb, color.a), texel.a * tint.a);
+}";
+
+const string multi_tint_main = "void main()
+{
+vec4 texel_color = texel();
+gl_FragColor = vec4(mix(texel_color.rgb, color.rgb, color.a), texel_color.a * tint.a);
+}";
+
+byte debug_view;
+
+#define MAX_OUTLINES 4096
+
+int pending_debug_view = -1; // set_debug_view - applied when the next frame starts
+
+Shader solid_shader;
+Shader tint_shader;
+Shader multi_tint_shader; // for multi texture batches
+GLint solid_color;
+GLint tint_color;
+GLint multi_tint_color;
+
+float outline_vertices[MAX_OUTLINES * 16]; // 4 lines each
+int outline_count;
+
+GLuint heatmap_id;
+byte* heatmap_pixels;
+int heatmap_width;
+int heatmap_height;
+
+void load_debug_views()
+{
+    solid_shader = load_shader_verbose(direct_vs, solid_fs);
+    tint_shader = load_shader_verbose(direct_vs, tint_fs);
+    solid_color = glGetUniformLocation(solid_shader.id, "color");
+    tint_color = glGetUniformLocation(tint_shader.id, "color");
+
+    if (texture_slots > 1)
+    {
+        multi_tint_shader = load_multi_texture_shader(texture_slots, multi_tint_main);
+        multi_tint_color = glGetUniformLocation(multi_tint_shader.id, "color");
+    }
+}
+
+void unload_debug_views()
+{
+    unload_shader(solid_shader);
+    unload_shader(tint_shader);
+
+    if (multi_tint_shader.id != 0)
+        unload_shader(multi_tint_shader);
+
+    if (heatmap_id != 0)
+        glDeleteTextures(1, &heatmap_id);
+
+    free(heatmap_pixels);
+}
+
+void next_debug_view()
+{
+    debug_view = (debug_view + 1) % DEBUG_VIEW_COUNT;
+
+    debug("Debug view %i", debug_view);
+}
+
+// from game code - the view changes when the next frame starts, since the
+// overdraw view has to clear and count from the first quad of a frame
+// loads the debug views when DEBUG didn't - benchmarks measure overdraw too
+void set_debug_view(const byte view)
+{
+    if (solid_shader.id == 0)
+        load_debug_views();
+
+    pending_debug_view = view % DEBUG_VIEW_COUNT;
+}
+
+// distinct colors for consecutive batches - golden ratio steps on the hue
+void batch_color(const uint batch, float* rgb)
+{
+    float hue = fmod(batch * 0.618034f, 1.f) * 6.f;
+    float x = 1.f - fabs(fmod(hue, 2.f) - 1.f);
+
+    rgb[0] = hue < 1 || hue >= 5 ? 1 : (hue < 2 || hue >= 4 ? x : 0);
+    rgb[1] = hue < 1 ? x : (hue < 3 ? 1 : (hue < 4 ? x : 0));
+    rgb[2] = hue < 2 ? 0 : (hue < 3 ? x : (hue < 5 ? 1 : x));
+}
+
+// shader for a draw call - the given one unless a debug view replaces it
+Shader debug_view_shader(const Shader shader)
+{
+    if (debug_view == DEBUG_VIEW_OVERDRAW)
+    {
+        glUseProgram(solid_shader.id);
+        glUniform4f(solid_color, 1.f / 255.f, 0, 0, 0);
+
+        return solid_shader;
+    }
+
+    if (debug_view == DEBUG_VIEW_BATCHES)
+    {
+        float rgb[3];
+        batch_color(current_stats.draw_calls, rgb);
+
+        if (shader.id == array_shader.id)
+        {
+            // no tint variant for arrays - flat quads
+            glUseProgram(solid_shader.id);
+            glUniform4f(solid_color, rgb[0], rgb[1], rgb[2], 0.6f);
+
+            return solid_shader;
+        }
+
+        if (shader.texture_slot >= 0)
+        {
+            glUseProgram(multi_tint_shader.id);
+            glUniform4f(multi_tint_color, rgb[0], rgb[1], rgb[2], 0.6f);
+
+            return multi_tint_shader;
+        }
+
+        glUseProgram(tint_shader.id);
+        glUniform4f(tint_color, rgb[0], rgb[1], rgb[2], 0.6f);
+
+        return tint_shader;
+    }
+
+    return shader;
+}
+
+// quad outlines are drawn over everything at the end of the frame
+void debug_view_outline(const Quad quad)
+{
+    if (outline_count >= MAX_OUTLINES)
+        return;
+
+    const Vector corners[] = { quad.top_left, quad.top_right, quad.bottom_right, quad.bottom_left };
+    float* vertices = outline_vertices + outline_count * 16;
+
+    for (int i = 0; i < 4; i++)
+    {
+        vertices[i * 4] = translate_x(corners[i].x);
+        vertices[i * 4 + 1] = translate_y(corners[i].y);
+        vertices[i * 4 + 2] = translate_x(corners[(i + 1) % 4].x);
+        vertices[i * 4 + 3] = translate_y(corners[(i + 1) % 4].y);
+    }
+
+    outline_count++;
+}
+
+void draw_outlines()
+{
+    glUseProgram(solid_shader.id);
+    glUniform4f(solid_color, 1.f, 0.9f, 0.f, 1.f);
+
+    glVertexAttribPointer(solid_shader.vertex_position, 2, GL_FLOAT, GL_FALSE, 0, outline_vertices);
+    glEnableVertexAttribArray(solid_shader.vertex_position);
+
+    glDrawArrays(GL_LINES, 0, outline_count * 8);
+
+    glDisableVertexAttribArray(solid_shader.vertex_position);
+    glUseProgram(0);
+
+    outline_count = 0;
+}
+
+void debug_view_begin_frame()
+{
+    if (pending_debug_view >= 0)
+    {
+        debug_view = pending_debug_view;
+        pending_debug_view = -1;
+    }
+
+    if (debug_view != DEBUG_VIEW_OVERDRAW)
+        return;
+
+    // counts add up on the red channel
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlendFunc(GL_ONE, GL_ONE);
+}
+
+// heat color for a number of layers
+void heat_color(const uint layers, byte* rgba)
+{
+    static const byte colors[][3] =
+    {
+        { 0, 0, 0 }, { 0, 0, 160 }, { 0, 160, 0 }, { 220, 220, 0 },
+        { 255, 128, 0 }, { 255, 0, 0 }, { 255, 0, 255 }, { 255, 255, 255 }
+    };
+
+    const byte* color = colors[layers < 7 ? layers : 7];
+
+    rgba[0] = color[0];
+    rgba[1] = color[1];
+    rgba[2] = color[2];
+    rgba[3] = 255;
+}
+
+// reads the counts back, measures them and replaces the frame with the heatmap
+void debug_view_end_frame()
+{
+    if (debug_view == DEBUG_VIEW_QUADS)
+        draw_outlines();
+
+    if (debug_view != DEBUG_VIEW_OVERDRAW)
+        return;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if (heatmap_width != viewport[2] || heatmap_height != viewport[3])
+    {
+        heatmap_width = viewport[2];
+        heatmap_height = viewport[3];
+        heatmap_pixels = (byte*)counted_realloc(heatmap_pixels, heatmap_width * heatmap_height * 4);
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(viewport[0], viewport[1], heatmap_width, heatmap_height, GL_RGBA, GL_UNSIGNED_BYTE, heatmap_pixels);
+
+    long total = 0;
+    long covered = 0;
+    uint overdraw_max = 0;
+
+    for (long i = 0; i < heatmap_width * heatmap_height; i++)
+    {
+        uint layers = heatmap_pixels[i * 4];
+
+        if (layers > 0)
+        {
+            total += layers;
+            covered++;
+        }
+
+        if (layers > overdraw_max)
+            overdraw_max = layers;
+
+        heat_color(layers, heatmap_pixels + i * 4);
+    }
+
+    current_stats.overdraw_average = covered > 0 ? (float)total / covered : 0;
+    current_stats.overdraw_max = overdraw_max;
+
+    if (frame_number % FRAMES_PER_SECOND == 0)
+        debug("Overdraw average %.2f max %i - %.0f%% of the screen covered",
+            current_stats.overdraw_average, overdraw_max, 100.f * covered / (heatmap_width * heatmap_height));
+
+    if (heatmap_id == 0)
+        glGenTextures(1, &heatmap_id);
+
+    glBindTexture(GL_TEXTURE_2D, heatmap_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, heatmap_width, heatmap_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, heatmap_pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // read back rows start at the bottom like the vertices
+    float vertices[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    float coordinates[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+
+    glDisable(GL_BLEND);
+    glUseProgram(base_shader.id);
+
+    glVertexAttribPointer(base_shader.vertex_position, 2, GL_FLOAT, GL_FALSE, 0, vertices);
+    glEnableVertexAttribArray(base_shader.vertex_position);
+    glVertexAttribPointer(base_shader.texture_position, 2, GL_FLOAT, GL_FALSE, 0, coordinates);
+    glEnableVertexAttribArray(base_shader.texture_position);
+    glVertexAttrib3f(base_shader.vertex_color, 1, 1, 1);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableVertexAttribArray(base_shader.vertex_position);
+    glDisableVertexAttribArray(base_shader.texture_position);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(PREMULTIPLIED_ALPHA ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+//**************************************************
+// STATS OVERLAY
+//**************************************************
+
+// with DEBUG on F2 shows the last frame stats on the top left corner
+// and logs them once a second
+
+#define OVERLAY_MAX_QUADS 4096
+
+// 3x5 pixel glyphs - top left pixel on bit 14
+const char OVERLAY_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/%";
+const word OVERLAY_GLYPHS[] =
+{
+    0x7b6f, 0x2c97, 0x73e7, 0x72cf, 0x5bc9, 0x79cf, 0x79ef, 0x7252, 0x7bef, 0x7bcf,
+    0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, 0x5bed, 0x7497, 0x126a,
+    0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492,
+    0x5b6f, 0x5b6a, 0x5bfd, 0x5aad, 0x5a92, 0x72a7, 0x0002, 0x0410, 0x01c0, 0x12a4,
+    0x52a5
+};
+
+bool show_stats;
+double frame_end; // ms
+
+float overlay_vertices[OVERLAY_MAX_QUADS * 12];
+int overlay_quads;
+
+void overlay_rect(const float x, const float y, const float width, const float height)
+{
+    if (overlay_quads >= OVERLAY_MAX_QUADS)
+        return;
+
+    float left = translate_x(x);
+    float top = translate_y(y);
+    float right = translate_x(x + width);
+    float bottom = translate_y(y + height);
+    float* v = overlay_vertices + overlay_quads * 12;
+
+    v[0] = left; v[1] = top; v[2] = right; v[3] = top; v[4] = left; v[5] = bottom;
+    v[6] = right; v[7] = top; v[8] = right; v[9] = bottom; v[10] = left; v[11] = bottom;
+
+    overlay_quads++;
+}
+
+void overlay_text(const float x, const float y, const char* text, const float size)
+{
+    for (int i = 0; text[i] != 0; i++)
+    {
+        const char* found = strchr(OVERLAY_CHARS, text[i]); // upper case only
+
+        if (text[i] == ' ' || found == NULL)
+            continue;
+
+        word glyph = OVERLAY_GLYPHS[found - OVERLAY_CHARS];
+
+        for (int bit = 0; bit < 15; bit++)
+            if (glyph & (1 << (14 - bit)))
+                overlay_rect(x + (i * 4 + bit % 3) * size, y + bit / 3 * size, size, size);
+    }
+}
+
+// draws the queued rects in one call
+void flush_overlay(const float r, const float g, const float b, const float a)
+{
+    glUseProgram(solid_shader.id);
+    glUniform4f(solid_color, r, g, b, a);
+
+    glVertexAttribPointer(solid_shader.vertex_position, 2, GL_FLOAT, GL_FALSE, 0, overlay_vertices);
+    glEnableVertexAttribArray(solid_shader.vertex_position);
+
+    glDrawArrays(GL_TRIANGLES, 0, overlay_quads * 6);
+
+    glDisableVertexAttribArray(solid_shader.vertex_position);
+    glUseProgram(0);
+
+    overlay_quads = 0;
+}
+
+void log_frame_stats()
+{
+    debug("Frame %.2f ms - tick %.2f ms - present %.2f ms - %i draw calls - %i sprites - %i vertices - "
+        "%i texture binds - %i program switches - %i shader compiles - %li bytes uploaded - "
+        "%i textures alive (%li bytes) - %i allocations - %li arena bytes - overdraw average %.2f max %i - gpu clear %.2f ms game %.2f ms debug view %.2f ms overlay %.2f ms",
+        frame_stats.frame_ms, frame_stats.tick_ms, frame_stats.present_ms,
+        frame_stats.draw_calls, frame_stats.sprites, frame_stats.vertices,
+        frame_stats.texture_binds, frame_stats.program_switches, frame_stats.shader_compiles,
+        frame_stats.bytes_uploaded, frame_stats.textures_alive, frame_stats.texture_bytes,
+        frame_stats.allocations, frame_stats.arena_bytes, frame_stats.overdraw_average, frame_stats.overdraw_max, frame_stats.gpu_ms[GPU_PASS_CLEAR], frame_stats.gpu_ms[GPU_PASS_GAME],
+        frame_stats.gpu_ms[GPU_PASS_DEBUG_VIEW], frame_stats.gpu_ms[GPU_PASS_OVERLAY]);
+}
+
+void toggle_stats()
+{
+    show_stats = ! show_stats;
+}
+
+void draw_stats_overlay()
+{
+    if (! show_stats)
+        return;
+
+    char lines[9][64];
+    int count = 0;
+
+    snprintf(lines[count++], 64, "FRAME %.2f MS TICK %.2f MS", frame_stats.frame_ms, frame_stats.tick_ms);
+    snprintf(lines[count++], 64, "PRESENT %.2f MS", frame_stats.present_ms);
+
+    if (gpu_timers)
+        snprintf(lines[count++], 64, "GPU CLEAR %.2f GAME %.2f VIEW %.2f UI %.2f",
+            frame_stats.gpu_ms[GPU_PASS_CLEAR], frame_stats.gpu_ms[GPU_PASS_GAME],
+            frame_stats.gpu_ms[GPU_PASS_DEBUG_VIEW], frame_stats.gpu_ms[GPU_PASS_OVERLAY]);
+    snprintf(lines[count++], 64, "DRAWS %i SPRITES %i VERTS %i", frame_stats.draw_calls, frame_stats.sprites, frame_stats.vertices);
+    snprintf(lines[count++], 64, "BINDS %i PROGRAMS %i SHADERS %i", frame_stats.texture_binds, frame_stats.program_switches, frame_stats.shader_compiles);
+    snprintf(lines[count++], 64, "UPLOADED %li KB ALLOCS %i", frame_stats.bytes_uploaded / 1024, frame_stats.allocations);
+    snprintf(lines[count++], 64, "TEXTURES %i VRAM %li KB", frame_stats.textures_alive, frame_stats.texture_bytes / 1024);
+    snprintf(lines[count++], 64, "ARENA %li KB PEAK %li KB", frame_stats.arena_bytes / 1024, frame_arena.peak / 1024);
+
+    if (frame_stats.overdraw_max > 0)
+        snprintf(lines[count++], 64, "OVERDRAW %.2f MAX %i", frame_stats.overdraw_average, frame_stats.overdraw_max);
+
+    float size = DISPLAY_HEIGHT / 270.f;
+    int longest = 0;
+
+    for (int i = 0; i < count; i++)
+        if ((int)strlen(lines[i]) > longest)
+            longest = strlen(lines[i]);
+
+    overlay_rect(0, 0, (longest * 4 + 3) * size, (count * 7 + 3) * size);
+    flush_overlay(0, 0, 0, 0.6f);
+
+    for (int i = 0; i < count; i++)
+        overlay_text(2 * size, (2 + i * 7) * size, lines[i], size);
+
+    flush_overlay(1, 1, 1, 1);
+}
+
+// closes the frame counters - frame_stats gets them and a new frame starts from 0
+void end_frame_stats()
+{
+    double now = now_ms();
+
+    current_stats.frame_ms = frame_end > 0 ? now - frame_end : 0;
+    current_stats.textures_alive = textures_alive();
+    current_stats.texture_bytes = textures_vram();
+    current_stats.arena_bytes = frame_arena.used;
+    frame_end = now;
+
+    frame_stats = current_stats;
+    memset(&current_stats, 0, sizeof(current_stats));
+
+    if (show_stats && frame_number % FRAMES_PER_SECOND == 0)
+        log_frame_stats();
+}
+
+//**************************************************
+// RENDERING
+//**************************************************
+
+// sprites are batched - consecutive sprites with the same texture and shader
+// go out in one glDrawElements - the batch flushes when those change, when it
+// fills up and after game_tick
+// with base_shader a batch binds up to TEXTURE_SLOTS textures at once and
+// every vertex picks its slot, so mixing those doesn't flush
+// texture array layers use the slot for the layer - any mix of them is a batch
+// game code making its own gl calls or changing uniforms of current_shader
+// between draws should call flush_sprites first
+
+#define MAX_BATCH_VERTICES 16384 // word indices
+#define MAX_BATCH_INDICES (MAX_BATCH_VERTICES * 3)
+
+typedef struct BatchVertex
+{
+    float x; // clip space
+    float y;
+    float u;
+    float v;
+    Color color; // normalized on the gpu
+    byte slot; // texture unit - layer for texture arrays
+    byte unused[3];
+} BatchVertex;
+
+BatchVertex batch_vertices[MAX_BATCH_VERTICES];
+word batch_indices[MAX_BATCH_INDICES];
+int batch_vertex_count;
+int batch_index_count;
+GLuint batch_textures[MAX_TEXTURE_SLOTS]; // on units 0 and up
+int batch_texture_count;
+byte batch_slot; // of the mesh being added
+GLuint batch_palette; // TEXTURE_INDEXED only
+bool batch_array; // a GL_TEXTURE_2D_ARRAY on unit 0
+Shader batch_shader;
+// corner of a quad at fractions u, v of its source
+Vector quad_point(const Quad quad, const float u, const float v)
+{
+    Vector result =
+    {
+        quad.top_left.x + u * (quad.top_right.x - quad.top_left.x) + v * (quad.bottom_left.x - quad.top_left.x),
+        quad.top_left.y + u * (quad.top_right.y - quad.top_left.y) + v * (quad.bottom_left.y - quad.top_left.y)
+    };
+
+    return result;
+}
+
+// shrinks destination and source to the part of source stored on the gpu
+// the quad is affine to its source so this works for any rotation, scale or flip
+// false when nothing is left to draw
+bool clip_to_stored(Quad* destination, Rect* source, const Rect stored)
+{
+    uint x0 = source->x > stored.x ? source->x : stored.x;
+    uint y0 = source->y > stored.y ? source->y : stored.y;
+    uint x1 = source->x + source->width < stored.x + stored.width ? source->x + source->width : stored.x + stored.width;
+    uint y1 = source->y + source->height < stored.y + stored.height ? source->y + source->height : stored.y + stored.height;
+
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+
+    if (x0 == source->x && y0 == source->y && x1 == source->x + source->width && y1 == source->y + source->height)
+        return true;
+
+    float u0 = (float)(x0 - source->x) / source->width;
+    float v0 = (float)(y0 - source->y) / source->height;
+    float u1 = (float)(x1 - source->x) / source->width;
+    float v1 = (float)(y1 - source->y) / source->height;
+
+    Quad quad = *destination;
+    destination->top_left = quad_point(quad, u0, v0);
+    destination->top_right = quad_point(quad, u1, v0);
+    destination->bottom_left = quad_point(quad, u0, v1);
+    destination->bottom_right = quad_point(quad, u1, v1);
+
+    source->x = x0;
+    source->y = y0;
+    source->width = x1 - x0;
+    source->height = y1 - y0;
+
+    return true;
+}
+
+void flush_sprites()
+{
+    if (batch_index_count == 0)
+        return;
+
+    Shader shader = batch_shader;
+
+    glUseProgram(shader.id);
+    shader = debug_view_shader(shader);
+    current_stats.program_switches++;
+
+    glVertexAttribPointer(shader.vertex_position, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), &batch_vertices[0].x);
+    glEnableVertexAttribArray(shader.vertex_position);
+
+    glVertexAttribPointer(shader.texture_position, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), &batch_vertices[0].u);
+    glEnableVertexAttribArray(shader.texture_position);
+
+    if (shader.vertex_color >= 0)
+    {
+        glVertexAttribPointer(shader.vertex_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BatchVertex), &batch_vertices[0].color);
+        glEnableVertexAttribArray(shader.vertex_color);
+    }
+
+    if (shader.texture_slot >= 0)
+    {
+        glVertexAttribPointer(shader.texture_slot, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(BatchVertex), &batch_vertices[0].slot);
+        glEnableVertexAttribArray(shader.texture_slot);
+    }
+
+    // indexed textures look their colors up on the palette
+    if (batch_palette != 0)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, batch_palette);
+        current_stats.texture_binds++;
+    }
+
+    // down to unit 0 so it stays active
+    for (int i = batch_texture_count - 1; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(batch_array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, batch_textures[i]);
+        current_stats.texture_binds++;
+    }
+
+    glDrawElements(GL_TRIANGLES, batch_index_count, GL_UNSIGNED_SHORT, batch_indices);
+
+    if (batch_array)
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    current_stats.draw_calls++;
+    current_stats.vertices += batch_vertex_count;
+
+    glDisableVertexAttribArray(shader.vertex_position);
+    glDisableVertexAttribArray(shader.texture_position);
+
+    if (shader.vertex_color >= 0)
+    {
+        glDisableVertexAttribArray(shader.vertex_color);
+        glVertexAttrib3f(shader.vertex_color, 1, 1, 1); // white for draws without colors
+    }
+
+    if (shader.texture_slot >= 0)
+        glDisableVertexAttribArray(shader.texture_slot);
+
+    glUseProgram(0);
+
+    batch_vertex_count = 0;
+    batch_index_count = 0;
+    batch_texture_count = 0;
+}
+
+// makes room for a mesh - flushes first if it can't join the batch
+// returns the index of its first vertex
+int begin_batch(const TextureEntry* entry, Shader shader, const int vertices, const int indices)
+{
+    int slots = 1;
+    bool array = entry->array != 0;
+
+    if (array)
+        shader = array_shader;
+    else if (shader.id == base_shader.id && texture_slots > 1 && TEXTURE_SLOTS > 1)
+    {
+        shader = multi_shader;
+        slots = TEXTURE_SLOTS < texture_slots ? TEXTURE_SLOTS : texture_slots;
+    }
+
+    int slot = -1;
+
+    for (int i = 0; i < batch_texture_count && slot < 0; i++)
+        if (batch_textures[i] == entry->id)
+            slot = i;
+
+    if (batch_index_count > 0 &&
+        ((slot < 0 && batch_texture_count >= slots) || batch_palette != entry->palette || batch_shader.id != shader.id ||
+         batch_vertex_count + vertices > MAX_BATCH_VERTICES || batch_index_count + indices > MAX_BATCH_INDICES))
+    {
+        flush_sprites();
+        slot = -1;
+    }
+
+    if (slot < 0)
+    {
+        slot = batch_texture_count++;
+        batch_textures[slot] = entry->id;
+    }
+
+    batch_slot = array ? entry->layer : slot;
+    batch_palette = entry->palette;
+    batch_array = array;
+    batch_shader = shader;
+
+    return batch_vertex_count;
+}
+
+void batch_vertex(const Vector position, const Vector offset, const float u, const float v, const Color color)
+{
+    BatchVertex* vertex = &batch_vertices[batch_vertex_count++];
+
+    vertex->x = translate_x(position.x + offset.x);
+    vertex->y = translate_y(position.y + offset.y);
+    vertex->u = u;
+    vertex->v = v;
+    vertex->color = color;
+    vertex->slot = batch_slot;
+}
+
+// adds the sprite mesh moved by offset and tinted by color
+void batch_mesh(const Sprite* sprite, const TextureEntry* entry, const Quad full, const Quad destination,
+    const Rect source, const Shader shader, const Vector offset, const Color color)
+{
+    Rect stored = entry->trim;
+
+    // whole image sprites with a hull draw the mesh as a fan
+    if (entry->hull_count > 0 &&
+        sprite->source.x == 0 && sprite->source.y == 0 &&
+        sprite->source.width == entry->width && sprite->source.height == entry->height)
+    {
+        int first = begin_batch(entry, shader, entry->hull_count, (entry->hull_count - 2) * 3);
+
+        for (int i = 0; i < entry->hull_count; i++)
+        {
+            Vector point = entry->hull[i];
+
+            batch_vertex(
+                quad_point(full, point.x / entry->width, point.y / entry->height), offset,
+                (point.x - stored.x) / stored.width,
+                (point.y - stored.y) / stored.height,
+                color);
+        }
+
+        for (int i = 1; i + 1 < entry->hull_count; i++)
+        {
+            batch_indices[batch_index_count++] = first;
+            batch_indices[batch_index_count++] = first + i;
+            batch_indices[batch_index_count++] = first + i + 1;
+        }
+
+        return;
+    }
+
+    // texture coordinates relative to the stored part of the image
+    float left = (float)(source.x - stored.x) / stored.width;
+    float top = (float)(source.y - stored.y) / stored.height;
+    float right = (float)(source.x + source.width - stored.x) / stored.width;
+    float bottom = (float)(source.y + source.height - stored.y) / stored.height;
+
+    int first = begin_batch(entry, shader, 4, 6);
+
+    batch_vertex(destination.top_left, offset, left, top, color);
+    batch_vertex(destination.top_right, offset, right, top, color);
+    batch_vertex(destination.bottom_left, offset, left, bottom, color);
+    batch_vertex(destination.bottom_right, offset, right, bottom, color);
+
+    batch_indices[batch_index_count++] = first;
+    batch_indices[batch_index_count++] = first + 1;
+    batch_indices[batch_index_count++] = first + 2;
+    batch_indices[batch_index_count++] = first + 2;
+    batch_indices[batch_index_count++] = first + 1;
+    batch_indices[batch_index_count++] = first + 3;
+}
+
+// color as the shaders expect it - rgb scaled by alpha with PREMULTIPLIED_ALPHA
+Color blend_color(Color color, const byte alpha)
+{
+    color.a = color.a * alpha / 255;
+
+    if (PREMULTIPLIED_ALPHA)
+    {
+        color.r = color.r * color.a / 255;
+        color.g = color.g * color.a / 255;
+        color.b = color.b * color.a / 255;
+    }
+
+    return color;
+}
+
+void draw_sprite(const Sprite* sprite)
+{
+    if (! (sprite->flags & SPRITE_VISIBLE) || (sprite->color.a == 0 && sprite->shadow == 0))
+        return;
+
+    current_stats.sprites++;
+    touch_texture(sprite->image);
+
+    TextureEntry* entry = texture_entry(sprite->image);
+
+    if (entry == NULL)
+        return;
+
+    Quad destination = sprite_quad(sprite);
+    Quad full = destination;
+    Rect source = { sprite->source.x, sprite->source.y, sprite->source.width, sprite->source.height };
+
+    if (debug_view == DEBUG_VIEW_QUADS)
+        debug_view_outline(full);
+
+    if (! clip_to_stored(&destination, &source, entry->trim))
+        return; // only transparent pixels
+
+    Shader shader = entry->palette != 0 ? palette_shader : current_shader;
+
+    // the shadow is the same mesh in black right before it - same batch
+    if (sprite->shadow > 0)
+    {
+        Vector offset = { SHADOW_OFFSET_X * sprite->scale, SHADOW_OFFSET_Y * sprite->scale };
+        Color black = { 0, 0, 0, sprite->shadow };
+
+        batch_mesh(sprite, entry, full, destination, source, shader, offset, blend_color(black, sprite->color.a));
+    }
+
+    if (sprite->color.a > 0)
+        batch_mesh(sprite, entry, full, destination, source, shader, VZero, blend_color(sprite->color, 255));
+}
+
+void draw_sprites(const Sprite* sprites, const int count)
+{
+    for (int i = 0; i < count; i++)
+        draw_sprite(&sprites[i]);
+}
+
+void draw(const Texture texture)
+{
+    Sprite sprite = sprite_from_texture(&texture);
+
+    draw_sprite(&sprite);
+}
+
+//**************************************************
+// TILEMAP
+//**************************************************
+
+// the map is a texture of tile indices and tilemap_fs looks the atlas tile up
+// per pixel - a map of any size is one quad clipped to the screen, so the
+// cost follows the pixels drawn and not the tiles
+// edits only upload the changed rect of the index texture when drawn
+
+// index 0 is empty - n is tile n - 1 of the atlas counting left to right
+const string tilemap_fs = "#version 100
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+varying vec2 texture_coordinate;
+uniform sampler2D texture0;
+uniform sampler2D map;
+uniform vec2 map_size;
+uniform vec2 tile_uv;
+uniform vec2 inset;
+uniform float atlas_columns;
+void main()
+{
+vec2 cell = floor(texture_coordinate);
+float index = floor(texture2D(map, (cell + 0.5) / map_size).r * 255.0 + 0.5);
+if (index < 0.5)
+discard;
+index -= 1.0;
+vec2 tile = vec2(mod(index, atlas_columns), floor(index / atlas_columns));
+vec2 inside = clamp(texture_coordinate - cell, inset, 1.0 - inset);
+gl_FragColor = texture2D(texture0, (tile + inside) * tile_uv);
+}";
+
+Shader tilemap_shader;
+GLint tilemap_map_size;
+GLint tilemap_tile_uv;
+GLint tilemap_inset;
+GLint tilemap_atlas_columns;
+
+void load_tilemap_shader()
+{
+    tilemap_shader = load_shader_verbose(direct_vs, tilemap_fs);
+    tilemap_map_size = glGetUniformLocation(tilemap_shader.id, "map_size");
+    tilemap_tile_uv = glGetUniformLocation(tilemap_shader.id, "tile_uv");
+    tilemap_inset = glGetUniformLocation(tilemap_shader.id, "inset");
+    tilemap_atlas_columns = glGetUniformLocation(tilemap_shader.id, "atlas_columns");
+
+    glUseProgram(tilemap_shader.id);
+    glUniform1i(glGetUniformLocation(tilemap_shader.id, "map"), 1);
+    glUseProgram(0);
+}
+
+// atlas tiles are tile_width x tile_height with no spacing - map starts empty
+Tilemap load_tilemap(const string atlas, const uint tile_width, const uint tile_height, const uint columns, const uint rows)
+{
+    Tilemap result;
+    TextureOptions options = texture_options();
+
+    // mips and trimming would mix or move the tiles
+    options.mipmaps = false;
+    options.trim = false;
+    options.hull = 0;
+
+    memset(&result, 0, sizeof(result));
+
+    if (columns == 0 || rows == 0 || tile_width == 0 || tile_height == 0)
+    {
+        debug("Tilemap of %s: %ix%i with %ix%i tiles not supported", atlas, columns, rows, tile_width, tile_height);
+        return result;
+    }
+
+    result.atlas = acquire_texture_options(atlas, options);
+    result.columns = columns;
+    result.rows = rows;
+    result.tile_width = tile_width;
+    result.tile_height = tile_height;
+    result.scale = 1.0f;
+
+    TextureEntry* entry = texture_entry(result.atlas);
+
+    if (entry == NULL)
+        return result;
+
+    if (entry->width < tile_width)
+    {
+        debug("Tilemap of %s: %ix%i tiles in a %ix%i atlas not supported", atlas, tile_width, tile_height, entry->width, entry->height);
+        release_texture(result.atlas);
+        memset(&result, 0, sizeof(result));
+        return result;
+    }
+
+    result.atlas_columns = entry->width / tile_width;
+    result.tiles = (byte*)counted_malloc(columns * rows);
+    memset(result.tiles, 0, columns * rows);
+
+    glGenTextures(1, &result.map_id);
+    glBindTexture(GL_TEXTURE_2D, result.map_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, columns, rows, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, result.tiles);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    current_stats.bytes_uploaded += columns * rows;
+
+    debug("Tilemap %ix%i of %s - %i atlas columns", columns, rows, atlas, result.atlas_columns);
+
+    return result;
+}
+
+void unload_tilemap(Tilemap* tilemap)
+{
+    flush_sprites();
+
+    if (tilemap->map_id != 0)
+        glDeleteTextures(1, &tilemap->map_id);
+
+    free(tilemap->tiles);
+    release_texture(tilemap->atlas);
+
+    memset(tilemap, 0, sizeof(Tilemap));
+}
+
+byte get_tile(const Tilemap* tilemap, const uint x, const uint y)
+{
+    if (x >= tilemap->columns || y >= tilemap->rows)
+        return 0;
+
+    return tilemap->tiles[y * tilemap->columns + x];
+}
+
+// grows the dirty rect - uploaded by the next draw_tilemap
+void set_tile(Tilemap* tilemap, const uint x, const uint y, const byte tile)
+{
+    if (x >= tilemap->columns || y >= tilemap->rows || tilemap->tiles[y * tilemap->columns + x] == tile)
+        return;
+
+    tilemap->tiles[y * tilemap->columns + x] = tile;
+
+    if (tilemap->dirty.width == 0)
+    {
+        tilemap->dirty.x = x;
+        tilemap->dirty.y = y;
+        tilemap->dirty.width = 1;
+        tilemap->dirty.height = 1;
+        return;
+    }
+
+    uint x1 = tilemap->dirty.x + tilemap->dirty.width;
+    uint y1 = tilemap->dirty.y + tilemap->dirty.height;
+
+    if (x < tilemap->dirty.x)
+        tilemap->dirty.x = x;
+
+    if (y < tilemap->dirty.y)
+        tilemap->dirty.y = y;
+
+    tilemap->dirty.width = (x + 1 > x1 ? x + 1 : x1) - tilemap->dirty.x;
+    tilemap->dirty.height = (y + 1 > y1 ? y + 1 : y1) - tilemap->dirty.y;
+}
+
+void upload_tile_changes(Tilemap* tilemap)
+{
+    Rect dirty = tilemap->dirty;
+
+    if (dirty.width == 0)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, tilemap->map_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, tilemap->columns);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.x, dirty.y, dirty.width, dirty.height, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+        tilemap->tiles + dirty.y * tilemap->columns + dirty.x);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    current_stats.bytes_uploaded += dirty.width * dirty.height;
+    tilemap->dirty.width = tilemap->dirty.height = 0;
+}
+
+void draw_tilemap(Tilemap* tilemap)
+{
+    TextureEntry* atlas = texture_entry(tilemap->atlas);
+
+    if (atlas == NULL || tilemap->tiles == NULL)
+        return;
+
+    flush_sprites(); // keeps the draw order
+    touch_texture(tilemap->atlas);
+    upload_tile_changes(tilemap);
+
+    // map rect clipped to the screen - coordinates in tiles
+    float tile_width = tilemap->tile_width * tilemap->scale;
+    float tile_height = tilemap->tile_height * tilemap->scale;
+    float left = tilemap->position.x > 0 ? tilemap->position.x : 0;
+    float top = tilemap->position.y > 0 ? tilemap->position.y : 0;
+    float right = tilemap->position.x + tilemap->columns * tile_width;
+    float bottom = tilemap->position.y + tilemap->rows * tile_height;
+
+    if (right > DISPLAY_WIDTH)
+        right = DISPLAY_WIDTH;
+
+    if (bottom > DISPLAY_HEIGHT)
+        bottom = DISPLAY_HEIGHT;
+
+    if (left >= right || top >= bottom)
+        return;
+
+    float u0 = (left - tilemap->position.x) / tile_width;
+    float v0 = (top - tilemap->position.y) / tile_height;
+    float u1 = (right - tilemap->position.x) / tile_width;
+    float v1 = (bottom - tilemap->position.y) / tile_height;
+
+    float vertices[] =
+    {
+        translate_x(left), translate_y(top), translate_x(right), translate_y(top),
+        translate_x(left), translate_y(bottom), translate_x(right), translate_y(bottom)
+    };
+
+    float coordinates[] = { u0, v0, u1, v0, u0, v1, u1, v1 };
+
+    if (debug_view == DEBUG_VIEW_QUADS)
+    {
+        Quad quad = { { left, top }, { right, top }, { left, bottom }, { right, bottom } };
+        debug_view_outline(quad);
+    }
+
+    Shader shader = tilemap_shader;
+
+    glUseProgram(shader.id);
+    glUniform2f(tilemap_map_size, tilemap->columns, tilemap->rows);
+    glUniform2f(tilemap_tile_uv, (float)tilemap->tile_width / atlas->width, (float)tilemap->tile_height / atlas->height);
+    glUniform2f(tilemap_inset, 0.5f / tilemap->tile_width, 0.5f / tilemap->tile_height);
+    glUniform1f(tilemap_atlas_columns, tilemap->atlas_columns);
+
+    if (debug_view == DEBUG_VIEW_OVERDRAW)
+        shader = debug_view_shader(shader);
+
+    current_stats.program_switches++;
+
+    glVertexAttribPointer(shader.vertex_position, 2, GL_FLOAT, GL_FALSE, 0, vertices);
+    glEnableVertexAttribArray(shader.vertex_position);
+    glVertexAttribPointer(shader.texture_position, 2, GL_FLOAT, GL_FALSE, 0, coordinates);
+    glEnableVertexAttribArray(shader.texture_position);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, tilemap->map_id);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas->id);
+    current_stats.texture_binds += 2;
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    current_stats.draw_calls++;
+    current_stats.vertices += 4;
+
+    glDisableVertexAttribArray(shader.vertex_position);
+    glDisableVertexAttribArray(shader.texture_position);
+    glUseProgram(0);
+}
+
+//**************************************************
+// CHUNK MAPS
+//**************************************************
+
+// every layer is cut in CHUNK_TILES x CHUNK_TILES chunks whose vertices are
+// built once into a vertex buffer - a frame only draws the chunks on screen
+// and moving or scaling the map is a uniform, so nothing gets rebuilt
+// a chunk with changed tiles is rebuilt the next time it is on screen
+// building is cpu only - many chunks at once, like when loading, are split
+// across CHUNK_THREADS workers and uploaded from the main thread
+
+#define CHUNK_QUADS (CHUNK_TILES * CHUNK_TILES)
+#define MAX_CHUNK_BUILDS 256 // chunks staged per round
+#define MAX_CHUNK_THREADS 16
+
+typedef struct ChunkVertex
+{
+    float x; // map pixels
+    float y;
+    float u;
+    float v;
+} ChunkVertex;
+
+// one round of chunks to build - workers take every threads'th one
+typedef struct ChunkBuild
+{
+    const ChunkMap* map;
+    const uint* chunks;
+    int count;
+    int threads; // main thread included
+    Vector tile_uv; // atlas size of a tile
+    Vector inset; // half a texel with linear filtering
+    word quads[MAX_CHUNK_BUILDS];
+} ChunkBuild;
+
+typedef struct ChunkWorker
+{
+    ChunkBuild* build;
+    int thread; // builds chunks thread, thread + threads...
+} ChunkWorker;
+
+// map pixels to clip space with transform - tinted by the layer
+const string chunk_vs = "#version 100
+attribute vec2 vertex_position;
+attribute vec2 texture_position;
+uniform vec4 transform;
+uniform vec4 layer_tint;
+varying vec2 texture_coordinate;
+varying vec4 tint;
+void main()
+{
+gl_Position = vec4(vertex_position * transform.xy + transform.zw, 0, 1);
+texture_coordinate = texture_position;
+tint = layer_tint;
+}";
+
+Shader chunk_shader;
+Shader chunk_solid_shader; // DEBUG only - overdraw and batches views
+GLint chunk_transform;
+GLint chunk_tint;
+GLint chunk_solid_transform;
+GLint chunk_solid_color;
+GLuint chunk_indices; // element buffer every chunk shares
+ChunkVertex* chunk_staging; // MAX_CHUNK_BUILDS chunks
+
+void load_chunk_shaders()
+{
+    chunk_shader = load_shader_verbose(chunk_vs, direct_fs);
+    chunk_transform = glGetUniformLocation(chunk_shader.id, "transform");
+    chunk_tint = glGetUniformLocation(chunk_shader.id, "layer_tint");
+
+    if (DEBUG)
+    {
+        chunk_solid_shader = load_shader_verbose(chunk_vs, solid_fs);
+        chunk_solid_transform = glGetUniformLocation(chunk_solid_shader.id, "transform");
+        chunk_solid_color = glGetUniformLocation(chunk_solid_shader.id, "color");
+    }
+
+    word indices[CHUNK_QUADS * 6];
+
+    for (int i = 0; i < CHUNK_QUADS; i++)
+    {
+        indices[i * 6] = i * 4;
+        indices[i * 6 + 1] = i * 4 + 1;
+        indices[i * 6 + 2] = i * 4 + 2;
+        indices[i * 6 + 3] = i * 4 + 2;
+        indices[i * 6 + 4] = i * 4 + 1;
+        indices[i * 6 + 5] = i * 4 + 3;
+    }
+
+    glGenBuffers(1, &chunk_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void unload_chunk_shaders()
+{
+    unload_shader(chunk_shader);
+
+    if (chunk_solid_shader.id != 0)
+        unload_shader(chunk_solid_shader);
+
+    glDeleteBuffers(1, &chunk_indices);
+    free(chunk_staging);
+    chunk_staging = NULL;
+}
+
+// atlas tiles are tile_width x tile_height with no spacing - layers start empty
+ChunkMap create_chunk_map(const string atlas, const uint tile_width, const uint tile_height,
+    const uint columns, const uint rows, const uint layers)
+{
+    ChunkMap result;
+    TextureOptions options = texture_options();
+
+    // mips and trimming would mix or move the tiles
+    options.mipmaps = false;
+    options.trim = false;
+    options.hull = 0;
+
+    memset(&result, 0, sizeof(result));
+
+    if (layers == 0 || layers > MAX_MAP_LAYERS || columns == 0 || rows == 0 || tile_width == 0 || tile_height == 0)
+    {
+        debug("Chunk map of %s: %ix%i with %i layers of %ix%i tiles not supported", atlas, columns, rows, layers, tile_width, tile_height);
+        return result;
+    }
+
+    result.atlas = acquire_texture_options(atlas, options);
+    result.columns = columns;
+    result.rows = rows;
+    result.tile_width = tile_width;
+    result.tile_height = tile_height;
+    result.layer_count = layers;
+    result.scale = 1.0f;
+
+    TextureEntry* entry = texture_entry(result.atlas);
+
+    if (entry == NULL)
+        return result;
+
+    if (entry->width < tile_width)
+    {
+        debug("Chunk map of %s: %ix%i tiles in a %ix%i atlas not supported", atlas, tile_width, tile_height, entry->width, entry->height);
+        release_texture(result.atlas);
+        memset(&result, 0, sizeof(result));
+        return result;
+    }
+
+    result.atlas_columns = entry->width / tile_width;
+    result.chunk_columns = (columns + CHUNK_TILES - 1) / CHUNK_TILES;
+    result.chunk_rows = (rows + CHUNK_TILES - 1) / CHUNK_TILES;
+
+    long tiles = (long)layers * columns * rows;
+    long chunks = (long)layers * result.chunk_columns * result.chunk_rows;
+
+    result.tiles = (word*)counted_malloc(tiles * sizeof(word));
+    result.chunks = (MapChunk*)counted_malloc(chunks * sizeof(MapChunk));
+    memset(result.tiles, 0, tiles * sizeof(word));
+    memset(result.chunks, 0, chunks * sizeof(MapChunk));
+
+    for (uint i = 0; i < layers; i++)
+    {
+        snprintf(result.layers[i].name, MAP_NAME_LENGTH, "layer %i", i + 1);
+        result.layers[i].opacity = 255;
+        result.layers[i].visible = 1;
+    }
+
+    debug("Chunk map %ix%i with %i layers of %s - %i chunks", columns, rows, layers, atlas, chunks);
+
+    return result;
+}
+
+// vertices of one chunk into the staging area - shares nothing with other builds
+word build_chunk(const ChunkBuild* build, const int index)
+{
+    const ChunkMap* map = build->map;
+    uint chunk = build->chunks[index];
+    uint layer_chunks = map->chunk_columns * map->chunk_rows;
+    uint layer = chunk / layer_chunks;
+    uint x0 = chunk % map->chunk_columns * CHUNK_TILES;
+    uint y0 = chunk % layer_chunks / map->chunk_columns * CHUNK_TILES;
+    uint x1 = x0 + CHUNK_TILES < map->columns ? x0 + CHUNK_TILES : map->columns;
+    uint y1 = y0 + CHUNK_TILES < map->rows ? y0 + CHUNK_TILES : map->rows;
+    const word* tiles = map->tiles + (long)layer * map->columns * map->rows;
+    ChunkVertex* vertex = chunk_staging + index * CHUNK_QUADS * 4;
+    word quads = 0;
+
+    for (uint y = y0; y < y1; y++)
+    {
+        for (uint x = x0; x < x1; x++)
+        {
+            word tile = tiles[y * map->columns + x];
+
+            if (tile == 0)
+                continue;
+
+            tile--;
+
+            float left = (float)(x * map->tile_width);
+            float top = (float)(y * map->tile_height);
+            float right = left + map->tile_width;
+            float bottom = top + map->tile_height;
+            float u0 = (tile % map->atlas_columns) * build->tile_uv.x + build->inset.x;
+            float v0 = (tile / map->atlas_columns) * build->tile_uv.y + build->inset.y;
+            float u1 = u0 + build->tile_uv.x - build->inset.x * 2;
+            float v1 = v0 + build->tile_uv.y - build->inset.y * 2;
+
+            vertex[0].x = left; vertex[0].y = top; vertex[0].u = u0; vertex[0].v = v0;
+            vertex[1].x = right; vertex[1].y = top; vertex[1].u = u1; vertex[1].v = v0;
+            vertex[2].x = left; vertex[2].y = bottom; vertex[2].u = u0; vertex[2].v = v1;
+            vertex[3].x = right; vertex[3].y = bottom; vertex[3].u = u1; vertex[3].v = v1;
+
+            vertex += 4;
+            quads++;
+        }
+    }
+
+    return quads;
+}
+
+DWORD WINAPI chunk_worker(LPVOID data)
+{
+    ChunkWorker* worker = (ChunkWorker*)data;
+    ChunkBuild* build = worker->build;
+
+    for (int i = worker->thread; i < build->count; i += build->threads)
+        build->quads[i] = build_chunk(build, i);
+
+    return 0;
+}
+
+void upload_chunk(ChunkMap* map, const uint index, const word quads, const ChunkVertex* vertices)
+{
+    MapChunk* chunk = &map->chunks[index];
+
+    chunk->dirty = false;
+    chunk->quads = quads;
+
+    if (quads == 0)
+    {
+        if (chunk->buffer != 0)
+            glDeleteBuffers(1, &chunk->buffer);
+
+        chunk->buffer = 0;
+        return;
+    }
+
+    if (chunk->buffer == 0)
+        glGenBuffers(1, &chunk->buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, chunk->buffer);
+    glBufferData(GL_ARRAY_BUFFER, quads * 4 * sizeof(ChunkVertex), vertices, GL_STATIC_DRAW);
+
+    current_stats.bytes_uploaded += quads * 4 * sizeof(ChunkVertex);
+}
+
+// builds and uploads any number of chunks - rounds of MAX_CHUNK_BUILDS
+void build_chunks(ChunkMap* map, const uint* chunks, const int count)
+{
+    TextureEntry* atlas = texture_entry(map->atlas);
+
+    if (atlas == NULL || count == 0)
+        return;
+
+    if (chunk_staging == NULL)
+        chunk_staging = (ChunkVertex*)counted_malloc(MAX_CHUNK_BUILDS * CHUNK_QUADS * 4 * sizeof(ChunkVertex));
+
+    ChunkBuild build;
+    build.map = map;
+    build.tile_uv.x = (float)map->tile_width / atlas->width;
+    build.tile_uv.y = (float)map->tile_height / atlas->height;
+    build.inset.x = PIXEL_ART ? 0 : 0.5f / atlas->width;
+    build.inset.y = PIXEL_ART ? 0 : 0.5f / atlas->height;
+
+    for (int first = 0; first < count; first += MAX_CHUNK_BUILDS)
+    {
+        build.chunks = chunks + first;
+        build.count = count - first < MAX_CHUNK_BUILDS ? count - first : MAX_CHUNK_BUILDS;
+
+        // a few chunks aren't worth starting threads for
+        int threads = CHUNK_THREADS < MAX_CHUNK_THREADS ? CHUNK_THREADS : MAX_CHUNK_THREADS;
+
+        if (build.count < 16 || threads < 0)
+            threads = 0;
+
+        HANDLE handles[MAX_CHUNK_THREADS];
+        ChunkWorker workers[MAX_CHUNK_THREADS + 1];
+        build.threads = threads + 1;
+
+        for (int i = 0; i <= threads; i++)
+        {
+            workers[i].build = &build;
+            workers[i].thread = i;
+        }
+
+        int started = 0;
+
+        while (started < threads)
+        {
+            handles[started] = CreateThread(NULL, 0, chunk_worker, &workers[started + 1], 0, NULL);
+
+            if (handles[started] == NULL)
+                break;
+
+            started++;
+        }
+
+        // the main thread takes slice 0 and those of workers that didn't start
+        for (int i = 0; i <= threads; i++)
+            if (i == 0 || i > started)
+                chunk_worker(&workers[i]);
+
+        if (started > 0)
+            WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+
+        for (int i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+
+        for (int i = 0; i < build.count; i++)
+            upload_chunk(map, build.chunks[i], build.quads[i], chunk_staging + i * CHUNK_QUADS * 4);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// builds every chunk - after loading or replacing all the tiles
+void build_chunk_map(ChunkMap* map)
+{
+    if (map->chunks == NULL)
+        return;
+
+    double start = now_ms();
+    int count = map->layer_count * map->chunk_columns * map->chunk_rows;
+    uint* chunks = (uint*)counted_malloc(count * sizeof(uint));
+
+    for (int i = 0; i < count; i++)
+        chunks[i] = i;
+
+    build_chunks(map, chunks, count);
+    free(chunks);
+
+    debug("Chunk map %i chunks built in %.1f ms", count, now_ms() - start);
+}
+
+// a .map file from tools map - every chunk is built before it returns
+ChunkMap load_chunk_map(const string filename)
+{
+    ChunkMap result;
+    DataHolder file = load_file(filename);
+    MapHeader* header = (MapHeader*)file.data;
+
+    memset(&result, 0, sizeof(result));
+
+    if (file.data == NULL || file.length < (long)sizeof(MapHeader) ||
+        header->magic != MAP_MAGIC || header->version != MAP_VERSION || file.length < map_size(header))
+    {
+        debug("Chunk map %s is not a version %i map file", filename, MAP_VERSION);
+        free(file.data);
+        return result;
+    }
+
+    header->atlas[MAP_ATLAS_LENGTH - 1] = 0;
+    result = create_chunk_map(header->atlas, header->tile_width, header->tile_height,
+        header->columns, header->rows, header->layers);
+
+    if (result.tiles != NULL)
+    {
+        long layer_tiles = (long)header->columns * header->rows;
+        byte* data = (byte*)(header + 1);
+
+        for (uint i = 0; i < header->layers; i++)
+        {
+            memcpy(&result.layers[i], data, sizeof(MapLayer));
+            result.layers[i].name[MAP_NAME_LENGTH - 1] = 0;
+            data += sizeof(MapLayer);
+
+            memcpy(result.tiles + i * layer_tiles, data, layer_tiles * sizeof(word));
+            data += layer_tiles * sizeof(word);
+        }
+
+        build_chunk_map(&result);
+    }
+
+    free(file.data);
+
+    return result;
+}
+
+void unload_chunk_map(ChunkMap* map)
+{
+    flush_sprites();
+
+    if (map->chunks != NULL)
+        for (uint i = 0; i < map->layer_count * map->chunk_columns * map->chunk_rows; i++)
+            if (map->chunks[i].buffer != 0)
+                glDeleteBuffers(1, &map->chunks[i].buffer);
+
+    free(map->tiles);
+    free(map->chunks);
+    release_texture(map->atlas);
+
+    memset(map, 0, sizeof(ChunkMap));
+}
+
+word get_map_tile(const ChunkMap* map, const uint layer, const uint x, const uint y)
+{
+    if (layer >= map->layer_count || x >= map->columns || y >= map->rows)
+        return 0;
+
+    return map->tiles[((long)layer * map->rows + y) * map->columns + x];
+}
+
+// the chunk is rebuilt by the next draw_chunk_map showing it
+void set_map_tile(ChunkMap* map, const uint layer, const uint x, const uint y, const word tile)
+{
+    if (layer >= map->layer_count || x >= map->columns || y >= map->rows)
+        return;
+
+    word* current = &map->tiles[((long)layer * map->rows + y) * map->columns + x];
+
+    if (*current == tile)
+        return;
+
+    *current = tile;
+    map->chunks[(layer * map->chunk_rows + y / CHUNK_TILES) * map->chunk_columns + x / CHUNK_TILES].dirty = true;
+}
+
+// a draw call for every chunk on screen with tiles - after rebuilding the dirty ones
+void draw_chunk_map(ChunkMap* map)
+{
+    TextureEntry* atlas = texture_entry(map->atlas);
+
+    if (atlas == NULL || map->tiles == NULL)
+        return;
+
+    flush_sprites(); // keeps the draw order
+    touch_texture(map->atlas);
+
+    // chunks on screen
+    float chunk_width = CHUNK_TILES * map->tile_width * map->scale;
+    float chunk_height = CHUNK_TILES * map->tile_height * map->scale;
+    int x0 = (int)floorf(-map->position.x / chunk_width);
+    int y0 = (int)floorf(-map->position.y / chunk_height);
+    int x1 = (int)ceilf((DISPLAY_WIDTH - map->position.x) / chunk_width);
+    int y1 = (int)ceilf((DISPLAY_HEIGHT - map->position.y) / chunk_height);
+
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    x1 = x1 < (int)map->chunk_columns ? x1 : (int)map->chunk_columns;
+    y1 = y1 < (int)map->chunk_rows ? y1 : (int)map->chunk_rows;
+
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    uint dirty[MAX_CHUNK_BUILDS];
+    int dirty_count = 0;
+
+    for (uint layer = 0; layer < map->layer_count; layer++)
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+            {
+                uint index = (layer * map->chunk_rows + y) * map->chunk_columns + x;
+
+                if (! map->chunks[index].dirty)
+                    continue;
+
+                dirty[dirty_count++] = index;
+
+                if (dirty_count == MAX_CHUNK_BUILDS)
+                {
+                    build_chunks(map, dirty, dirty_count);
+                    dirty_count = 0;
+                }
+            }
+
+    build_chunks(map, dirty, dirty_count);
+
+    // the debug views that replace the shader need one with the transform
+    bool solid = chunk_solid_shader.id != 0 &&
+        (debug_view == DEBUG_VIEW_OVERDRAW || debug_view == DEBUG_VIEW_BATCHES);
+    Shader shader = solid ? chunk_solid_shader : chunk_shader;
+
+    glUseProgram(shader.id);
+    glUniform4f(solid ? chunk_solid_transform : chunk_transform,
+        2.f * map->scale / DISPLAY_WIDTH, -2.f * map->scale / DISPLAY_HEIGHT,
+        translate_x(map->position.x), translate_y(map->position.y));
+    current_stats.program_switches++;
+
+    if (debug_view == DEBUG_VIEW_OVERDRAW)
+        glUniform4f(chunk_solid_color, 1.f / 255.f, 0, 0, 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas->id);
+    current_stats.texture_binds++;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk_indices);
+    glEnableVertexAttribArray(shader.vertex_position);
+
+    if (! solid)
+        glEnableVertexAttribArray(shader.texture_position);
+
+    for (uint layer = 0; layer < map->layer_count; layer++)
+    {
+        if (! map->layers[layer].visible || map->layers[layer].opacity == 0)
+            continue;
+
+        if (! solid)
+        {
+            Color white = { 255, 255, 255, 255 };
+            Color tint = blend_color(white, map->layers[layer].opacity);
+
+            glUniform4f(chunk_tint, tint.r / 255.f, tint.g / 255.f, tint.b / 255.f, tint.a / 255.f);
+        }
+
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+            {
+                MapChunk* chunk = &map->chunks[(layer * map->chunk_rows + y) * map->chunk_columns + x];
+
+                if (chunk->quads == 0)
+                    continue;
+
+                if (debug_view == DEBUG_VIEW_BATCHES)
+                {
+                    float rgb[3];
+                    batch_color(current_stats.draw_calls, rgb);
+                    glUniform4f(chunk_solid_color, rgb[0], rgb[1], rgb[2], 0.6f);
+                }
+
+                if (debug_view == DEBUG_VIEW_QUADS)
+                {
+                    float left = map->position.x + x * chunk_width;
+                    float top = map->position.y + y * chunk_height;
+                    Quad quad =
+                    {
+                        { left, top }, { left + chunk_width, top },
+                        { left, top + chunk_height }, { left + chunk_width, top + chunk_height }
+                    };
+
+                    debug_view_outline(quad);
+                }
+
+                glBindBuffer(GL_ARRAY_BUFFER, chunk->buffer);
+                glVertexAttribPointer(shader.vertex_position, 2, GL_FLOAT, GL_FALSE, sizeof(ChunkVertex), (void*)0);
+
+                if (! solid)
+                    glVertexAttribPointer(shader.texture_position, 2, GL_FLOAT, GL_FALSE, sizeof(ChunkVertex),
+                        (void*)(2 * sizeof(float)));
+
+                glDrawElements(GL_TRIANGLES, chunk->quads * 6, GL_UNSIGNED_SHORT, 0);
+                current_stats.draw_calls++;
+                current_stats.vertices += chunk->quads * 4;
+            }
+    }
+
+    glDisableVertexAttribArray(shader.vertex_position);
+
+    if (! solid)
+        glDisableVertexAttribArray(shader.texture_position);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+//**************************************************
+// ANIMATION
+//**************************************************
+
+// clips are frame lists over a sheet - a source rect and milliseconds each
+// Animations holds one player per sprite of an array, stored as columns so
+// update_animations is one tight pass - a player only touches its sprite
+// when the frame changes, writing source (and image when a clip starts)
+// every clip frame knows the next one - ping pong clips are unrolled when
+// added - so advancing needs no clip lookups or mode checks
+// frames can raise an event - collected in animation_events every update
+
+#define MAX_CLIPS 256
+#define MAX_CLIP_FRAMES 4096 // of every clip together - ping pong counts twice
+#define MAX_ANIMATION_EVENTS 1024 // per update - the rest are dropped
+
+#define ANIMATION_LOOP 0
+#define ANIMATION_PING_PONG 1 // forward then back
+#define ANIMATION_ONCE 2 // stops on the last frame
+
+typedef struct AnimationClip
+{
+    word image; // TextureHandle of the sheet
+    word first; // on clip_frames
+    word count; // frames as added
+    byte mode; // ANIMATION_*
+} AnimationClip;
+
+typedef struct AnimationEvent
+{
+    int player; // same index as its sprite
+    word clip;
+    byte event;
+} AnimationEvent;
+
+// players in columns - index i drives sprites[i] of the array given to update
+typedef struct Animations
+{
+    int count;
+    word* clip;
+    word* frame; // on clip_frames
+    float* time; // ms left on the frame
+    float* speed; // 1 is normal - 0 is stopped
+    int* due; // players changing frame - scratch of update_animations
+} Animations;
+
+AnimationClip clips[MAX_CLIPS];
+int clip_count;
+SpriteRect clip_frames[MAX_CLIP_FRAMES];
+float clip_durations[MAX_CLIP_FRAMES]; // ms
+word clip_next[MAX_CLIP_FRAMES]; // itself for the last frame of once clips
+byte clip_events[MAX_CLIP_FRAMES]; // raised when the frame starts - 0 is none
+int clip_frame_count;
+
+AnimationEvent animation_events[MAX_ANIMATION_EVENTS];
+int animation_event_count;
+
+// returns the clip - -1 when clips or frames are full
+int add_clip(const TextureHandle image, const SpriteRect* frames, const float* durations, const int count, const byte mode)
+{
+    // the way back of ping pong skips both ends
+    int stored = mode == ANIMATION_PING_PONG && count > 2 ? count * 2 - 2 : count;
+
+    if (count <= 0 || clip_count >= MAX_CLIPS || clip_frame_count + stored > MAX_CLIP_FRAMES)
+    {
+        debug("Animation clip of %i frames doesn't fit - %i clips and %i frames in use", count, clip_count, clip_frame_count);
+        return -1;
+    }
+
+    AnimationClip* clip = &clips[clip_count];
+
+    clip->image = image;
+    clip->first = clip_frame_count;
+    clip->count = count;
+    clip->mode = mode;
+
+    for (int i = 0; i < stored; i++)
+    {
+        int frame = i < count ? i : stored - i;
+        int index = clip->first + i;
+
+        clip_frames[index] = frames[frame];
+        clip_durations[index] = durations[frame] > 1.f ? durations[frame] : 1.f; // so updates always end
+        clip_next[index] = i + 1 < stored ? index + 1 : clip->first;
+        clip_events[index] = 0;
+    }
+
+    if (mode == ANIMATION_ONCE)
+        clip_next[clip->first + count - 1] = clip->first + count - 1;
+
+    clip_frame_count += stored;
+
+    return clip_count++;
+}
+
+// count frames of a sheet grid from cell first, left to right - same duration each
+int add_grid_clip(const TextureHandle image, const uint frame_width, const uint frame_height,
+    const int first, const int count, const float duration, const byte mode)
+{
+    TextureEntry* entry = texture_entry(image);
+
+    if (entry == NULL || count <= 0 || count > MAX_CLIP_FRAMES ||
+        frame_width == 0 || frame_width > entry->width || frame_height > entry->height)
+        return -1;
+
+    SpriteRect frames[MAX_CLIP_FRAMES];
+    float durations[MAX_CLIP_FRAMES];
+    int columns = entry->width / frame_width;
+
+    for (int i = 0; i < count; i++)
+    {
+        frames[i].x = (first + i) % columns * frame_width;
+        frames[i].y = (first + i) / columns * frame_height;
+        frames[i].width = frame_width;
+        frames[i].height = frame_height;
+        durations[i] = duration;
+    }
+
+    return add_clip(image, frames, durations, count, mode);
+}
+
+// raised every time the frame starts - both ways on ping pong clips
+void set_clip_event(const int clip, const int frame, const byte event)
+{
+    if (clip < 0 || clip >= clip_count || frame < 0 || frame >= clips[clip].count)
+        return;
+
+    clip_events[clips[clip].first + frame] = event;
+
+    if (clips[clip].mode == ANIMATION_PING_PONG && frame > 0 && frame < clips[clip].count - 1)
+        clip_events[clips[clip].first + clips[clip].count * 2 - 2 - frame] = event;
+}
+
+// forgets every clip - players still using them must be restarted
+void clear_clips()
+{
+    clip_count = 0;
+    clip_frame_count = 0;
+}
+
+// count stopped players
+Animations create_animations(const int count)
+{
+    Animations result;
+
+    result.count = count;
+    result.clip = (word*)counted_malloc(count * sizeof(word));
+    result.frame = (word*)counted_malloc(count * sizeof(word));
+    result.time = (float*)counted_malloc(count * sizeof(float));
+    result.speed = (float*)counted_malloc(count * sizeof(float));
+    result.due = (int*)counted_malloc(count * sizeof(int));
+
+    memset(result.clip, 0, count * sizeof(word));
+    memset(result.frame, 0, count * sizeof(word));
+    memset(result.time, 0, count * sizeof(float));
+    memset(result.speed, 0, count * sizeof(float));
+
+    return result;
+}
+
+void free_animations(Animations* animations)
+{
+    free(animations->clip);
+    free(animations->frame);
+    free(animations->time);
+    free(animations->speed);
+    free(animations->due);
+
+    memset(animations, 0, sizeof(Animations));
+}
+
+void raise_animation_event(const Animations* animations, const int player, const int frame)
+{
+    if (clip_events[frame] == 0 || animation_event_count >= MAX_ANIMATION_EVENTS)
+        return;
+
+    AnimationEvent* event = &animation_events[animation_event_count++];
+
+    event->player = player;
+    event->clip = animations->clip[player];
+    event->event = clip_events[frame];
+}
+
+// from the first frame - sets the sprite image to the clip sheet
+void play_animation(Animations* animations, const int player, const int clip, Sprite* sprite)
+{
+    if (player < 0 || player >= animations->count || clip < 0 || clip >= clip_count)
+        return;
+
+    int frame = clips[clip].first;
+
+    animations->clip[player] = clip;
+    animations->frame[player] = frame;
+    animations->time[player] = clip_durations[frame];
+    animations->speed[player] = 1;
+    sprite->image = clips[clip].image;
+    sprite->source = clip_frames[frame];
+
+    raise_animation_event(animations, player, frame);
+}
+
+// 0 stops it where it is
+void set_animation_speed(Animations* animations, const int player, const float speed)
+{
+    if (player >= 0 && player < animations->count)
+        animations->speed[player] = speed;
+}
+
+// once clips stopped on their last frame or stopped by speed 0
+bool animation_stopped(const Animations* animations, const int player)
+{
+    return player < 0 || player >= animations->count || animations->speed[player] == 0;
+}
+
+// advances every player by delta ticks - player i writes to sprites[i]
+void update_animations(Animations* animations, Sprite* sprites, const float delta)
+{
+    float elapsed = delta * FRAME_TARGET;
+    float* time = animations->time;
+    float* speed = animations->speed;
+    word* frame = animations->frame;
+    int count = animations->count;
+
+    animation_event_count = 0;
+
+    // the whole pass for most players on most ticks
+    for (int i = 0; i < count; i++)
+        time[i] -= elapsed * speed[i];
+
+    // players due a new frame are listed without branches - which ones is
+    // random so a branch per player would mostly be mispredicted
+    int* due = animations->due;
+    int due_count = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        due[due_count] = i;
+        due_count += (time[i] <= 0) & (speed[i] != 0);
+    }
+
+    for (int d = 0; d < due_count; d++)
+    {
+        int i = due[d];
+        int index = frame[i];
+
+        // a big delta can cross several frames
+        while (time[i] <= 0)
+        {
+            int next = clip_next[index];
+
+            if (next == index)
+            {
+                speed[i] = 0;
+                time[i] = 0;
+                break;
+            }
+
+            index = next;
+            time[i] += clip_durations[index];
+            raise_animation_event(animations, i, index);
+        }
+
+        frame[i] = index;
+        sprites[i].source = clip_frames[index];
+    }
+}
+
+//**************************************************
+// TWEENS
+//**************************************************
+
+// a tween eases a float (or a byte like alpha) from one value to another
+// they live in a fixed pool kept dense - columns updated in a few passes of
+// straight loops, and finished or cancelled ones swapped out with the last
+// easings are sampled into tables at load, so every one of them is the same
+// lookup and lerp - no call or branch per tween
+// handles stay valid while the tween moves in the pool and go stale when it ends
+
+#define MAX_TWEENS 65536
+#define EASE_SAMPLES 256
+
+#define EASE_LINEAR 0
+#define EASE_IN_QUAD 1
+#define EASE_OUT_QUAD 2
+#define EASE_IN_OUT_QUAD 3
+#define EASE_IN_CUBIC 4
+#define EASE_OUT_CUBIC 5
+#define EASE_IN_OUT_CUBIC 6
+#define EASE_IN_OUT_SINE 7
+#define EASE_OUT_BACK 8 // overshoots and settles
+#define EASE_OUT_BOUNCE 9
+#define EASE_STEP 10 // jumps at the end - blinking with a yoyo repeat
+#define EASE_COUNT 11
+
+#define TWEEN_BYTE 1 // target is a byte - clamped to 0 - 255
+#define TWEEN_YOYO 2 // repeats go back and forth
+
+typedef uint Tween; // handle - 0 is none
+
+typedef float (*EaseFunction)(const float t);
+
+// dense columns - tween_count used
+void* tween_target[MAX_TWEENS];
+float tween_start[MAX_TWEENS];
+float tween_change[MAX_TWEENS];
+float tween_time[MAX_TWEENS]; // ms - negative while delayed
+float tween_rate[MAX_TWEENS]; // 1 / duration
+float tween_progress[MAX_TWEENS]; // 0 - 1 this update
+int tween_repeats[MAX_TWEENS]; // left - -1 forever
+byte tween_ease[MAX_TWEENS];
+byte tween_flags[MAX_TWEENS]; // TWEEN_*
+word tween_slot_of[MAX_TWEENS]; // handle slot of every dense tween
+int tween_count;
+int tween_peak;
+
+// handle slots - a tween keeps its slot while it moves in the dense columns
+uint tween_dense[MAX_TWEENS]; // dense index of every slot
+word tween_generation[MAX_TWEENS];
+word tween_free[MAX_TWEENS]; // stack of free slots
+int tween_free_count;
+
+float ease_tables[EASE_COUNT][EASE_SAMPLES + 2]; // last sample twice for t = 1
+
+float ease_linear(const float t) { return t; }
+float ease_in_quad(const float t) { return t * t; }
+float ease_out_quad(const float t) { return t * (2 - t); }
+float ease_in_out_quad(const float t) { return t < 0.5f ? 2 * t * t : -1 + (4 - 2 * t) * t; }
+float ease_in_cubic(const float t) { return t * t * t; }
+float ease_out_cubic(const float t) { return (t - 1) * (t - 1) * (t - 1) + 1; }
+float ease_in_out_cubic(const float t) { return t < 0.5f ? 4 * t * t * t : (t - 1) * (2 * t - 2) * (2 * t - 2) + 1; }
+float ease_in_out_sine(const float t) { return 0.5f - cosf(t * PI) * 0.5f; }
+float ease_out_back(const float t) { return 1 + 2.70158f * powf(t - 1, 3) + 1.70158f * powf(t - 1, 2); }
+float ease_step(const float t) { return t < 1 ? 0 : 1; }
+
+float ease_out_bounce(float t)
+{
+    if (t < 1 / 2.75f)
+        return 7.5625f * t * t;
+
+    if (t < 2 / 2.75f)
+    {
+        t -= 1.5f / 2.75f;
+        return 7.5625f * t * t + 0.75f;
+    }
+
+    if (t < 2.5f / 2.75f)
+    {
+        t -= 2.25f / 2.75f;
+        return 7.5625f * t * t + 0.9375f;
+    }
+
+    t -= 2.625f / 2.75f;
+    return 7.5625f * t * t + 0.984375f;
+}
+
+const EaseFunction easings[EASE_COUNT] =
+{
+    ease_linear, ease_in_quad, ease_out_quad, ease_in_out_quad,
+    ease_in_cubic, ease_out_cubic, ease_in_out_cubic, ease_in_out_sine,
+    ease_out_back, ease_out_bounce, ease_step
+};
+
+void load_tweens()
+{
+    for (int e = 0; e < EASE_COUNT; e++)
+    {
+        for (int i = 0; i <= EASE_SAMPLES; i++)
+            ease_tables[e][i] = easings[e]((float)i / EASE_SAMPLES);
+
+        ease_tables[e][EASE_SAMPLES + 1] = ease_tables[e][EASE_SAMPLES];
+    }
+
+    for (int i = 0; i < MAX_TWEENS; i++)
+        tween_free[i] = MAX_TWEENS - 1 - i;
+
+    tween_free_count = MAX_TWEENS;
+    tween_count = 0;
+}
+
+// top half of the handles of a slot - never 0 so no handle is 0
+uint tween_tag(const uint slot)
+{
+    return tween_generation[slot] % 0xFFFF + 1;
+}
+
+// dense index of a live handle - -1 when it ended
+int tween_index(const Tween tween)
+{
+    uint slot = tween & 0xFFFF;
+
+    if (tween == 0 || tween_tag(slot) != tween >> 16)
+        return -1;
+
+    return tween_dense[slot];
+}
+
+Tween add_tween(void* target, const float from, const float to, const float duration, const byte ease, const byte flags)
+{
+    if (tween_free_count == 0 || target == NULL)
+    {
+        debug("Tween pool full - %i tweens", MAX_TWEENS);
+        return 0;
     }
-	else
-	{
-    	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	}
 
-    // Unbind current texture
-    glBindTexture(GL_TEXTURE_2D, 0);
+    int slot = tween_free[--tween_free_count];
+    int i = tween_count++;
+
+    tween_target[i] = target;
+    tween_start[i] = from;
+    tween_change[i] = to - from;
+    tween_time[i] = 0;
+    tween_rate[i] = duration > 0 ? 1.f / duration : 1e9f;
+    tween_progress[i] = 0;
+    tween_repeats[i] = 0;
+    tween_ease[i] = ease < EASE_COUNT ? ease : EASE_LINEAR;
+    tween_flags[i] = flags;
+    tween_slot_of[i] = slot;
+    tween_dense[slot] = i;
+
+    if (tween_count > tween_peak)
+        tween_peak = tween_count;
+
+    return tween_tag(slot) << 16 | slot;
+}
+
+// from the current value to another in duration ms
+Tween tween(float* target, const float to, const float duration, const byte ease)
+{
+    return add_tween(target, *target, to, duration, ease, 0);
+}
+
+Tween tween_from(float* target, const float from, const float to, const float duration, const byte ease)
+{
+    return add_tween(target, from, to, duration, ease, 0);
+}
+
+// alpha and other byte fields
+Tween tween_byte(byte* target, const byte to, const float duration, const byte ease)
+{
+    return add_tween(target, *target, to, duration, ease, TWEEN_BYTE);
+}
+
+// -1 repeats forever - yoyo goes back the way it came on every other one
+void set_tween_repeat(const Tween tween, const int repeats, const bool yoyo)
+{
+    int i = tween_index(tween);
+
+    if (i < 0)
+        return;
+
+    tween_repeats[i] = repeats;
+    tween_flags[i] = yoyo ? tween_flags[i] | TWEEN_YOYO : tween_flags[i] & ~TWEEN_YOYO;
+}
+
+// the target holds the start value while it waits
+void set_tween_delay(const Tween tween, const float delay)
+{
+    int i = tween_index(tween);
+
+    if (i >= 0)
+        tween_time[i] = -delay;
+}
+
+bool tween_active(const Tween tween)
+{
+    return tween_index(tween) >= 0;
+}
+
+// the last tween takes its place - the handle goes stale
+void remove_tween(const int i)
+{
+    int last = --tween_count;
+    int slot = tween_slot_of[i];
+
+    tween_generation[slot]++;
+    tween_free[tween_free_count++] = slot;
+
+    if (i == last)
+        return;
+
+    tween_target[i] = tween_target[last];
+    tween_start[i] = tween_start[last];
+    tween_change[i] = tween_change[last];
+    tween_time[i] = tween_time[last];
+    tween_rate[i] = tween_rate[last];
+    tween_progress[i] = tween_progress[last];
+    tween_repeats[i] = tween_repeats[last];
+    tween_ease[i] = tween_ease[last];
+    tween_flags[i] = tween_flags[last];
+    tween_slot_of[i] = tween_slot_of[last];
+    tween_dense[tween_slot_of[i]] = i;
+}
+
+// leaves the target where it is
+void cancel_tween(const Tween tween)
+{
+    int i = tween_index(tween);
+
+    if (i >= 0)
+        remove_tween(i);
+}
+
+// every tween writing to target - before freeing what holds it
+void cancel_tweens_of(const void* target)
+{
+    for (int i = tween_count - 1; i >= 0; i--)
+        if (tween_target[i] == target)
+            remove_tween(i);
+}
+
+void cancel_all_tweens()
+{
+    while (tween_count > 0)
+        remove_tween(tween_count - 1);
+}
+
+// advances every tween by delta ticks and writes the targets
+void update_tweens(const float delta)
+{
+    float elapsed = delta * FRAME_TARGET;
+    int count = tween_count;
+
+    // progress - plain float math the compiler can vectorize
+    for (int i = 0; i < count; i++)
+    {
+        float t = (tween_time[i] += elapsed) * tween_rate[i];
+
+        t = t > 0 ? t : 0;
+        tween_progress[i] = t < 1 ? t : 1;
+    }
+
+    // eased values into the targets
+    for (int i = 0; i < count; i++)
+    {
+        float x = tween_progress[i] * EASE_SAMPLES;
+        int sample = (int)x;
+        const float* table = ease_tables[tween_ease[i]];
+        float eased = table[sample] + (table[sample + 1] - table[sample]) * (x - sample);
+        float value = tween_start[i] + tween_change[i] * eased;
+
+        if (tween_flags[i] & TWEEN_BYTE)
+            *(byte*)tween_target[i] = value < 0 ? 0 : (value > 255 ? 255 : (byte)(value + 0.5f));
+        else
+            *(float*)tween_target[i] = value;
+    }
+
+    // finished ones repeat or leave - backwards so the one swapped in was already seen
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (tween_progress[i] < 1)
+            continue;
+
+        if (tween_repeats[i] == 0)
+        {
+            remove_tween(i);
+            continue;
+        }
+
+        if (tween_repeats[i] > 0)
+            tween_repeats[i]--;
+
+        tween_time[i] -= 1.f / tween_rate[i];
+
+        if (tween_flags[i] & TWEEN_YOYO)
+        {
+            tween_start[i] += tween_change[i];
+            tween_change[i] = -tween_change[i];
+        }
+    }
+}
+
+//**************************************************
+// PARTICLES
+//**************************************************
+
+// a Particles system holds particles of one image in columns - emitters add
+// to it, update_particles moves them in bulk (4 at a time with SSE2) and
+// removes the dead by swapping in the last one
+// drawing is a single glDrawArrays of point sprites - the columns are the
+// vertex attributes as they are, and fading and shrinking with age happen
+// in the vertex shader, so the cpu builds no vertices at all
+// point sprites don't rotate and the gpu caps their size - particle_max_size
+
+typedef struct Particles
+{
+    int count;
+    int capacity;
+    float* x; // screen pixels
+    float* y;
+    float* velocity_x; // pixels per second
+    float* velocity_y;
+    float* life; // ms left
+    float* fade; // 1 / ms lived in total
+    float* size; // pixels at birth
+    Color* color; // at birth - alpha fades with life
+    word image; // TextureHandle
+    Vector gravity; // pixels per second squared
+    float drag; // velocity lost per second - 0 to 1
+    float end_scale; // size multiplier at death
+} Particles;
+
+// spawns into a Particles system - spreads are +- random ranges
+typedef struct Emitter
+{
+    Vector position;
+    Vector area; // half size of the spawn box
+    Vector velocity;
+    Vector velocity_spread;
+    float life; // ms
+    float life_spread;
+    float size;
+    float size_spread;
+    Color color;
+    float rate; // particles per second - 0 for bursts only
+    float owed; // fraction of a particle carried to the next update
+} Emitter;
+
+const string particle_vs = "#version 100
+attribute float particle_x;
+attribute float particle_y;
+attribute float particle_size;
+attribute vec4 particle_color;
+attribute float particle_life;
+attribute float particle_fade;
+uniform vec4 transform;
+uniform float point_scale;
+uniform float end_scale;
+uniform float premultiplied;
+varying vec4 tint;
+void main()
+{
+float age = clamp(particle_life * particle_fade, 0.0, 1.0);
+gl_Position = vec4(vec2(particle_x, particle_y) * transform.xy + transform.zw, 0, 1);
+gl_PointSize = particle_size * mix(end_scale, 1.0, age) * point_scale;
+tint = vec4(particle_color.rgb * mix(1.0, particle_color.a * age, premultiplied), particle_color.a * age);
+}";
+
+// solid replaces the texel for the debug views
+const string particle_fs = "#version 100
+precision mediump float;
+varying vec4 tint;
+uniform sampler2D texture0;
+uniform vec4 color;
+uniform float solid;
+void main()
+{
+gl_FragColor = mix(texture2D(texture0, gl_PointCoord) * tint, color, solid);
+}";
+
+#define PARTICLE_ATTRIBUTES 6
+
+Shader particle_shader;
+GLint particle_attributes[PARTICLE_ATTRIBUTES]; // x, y, size, color, life, fade
+GLint particle_transform;
+GLint particle_point_scale;
+GLint particle_end_scale;
+GLint particle_premultiplied;
+GLint particle_color;
+GLint particle_solid;
+float particle_max_size; // point size cap of the gpu in window pixels
+uint particle_seed = 2463534242u;
+
+void load_particles()
+{
+    const string names[PARTICLE_ATTRIBUTES] =
+    {
+        "particle_x", "particle_y", "particle_size", "particle_color", "particle_life", "particle_fade"
+    };
+
+    particle_shader = load_shader_verbose(particle_vs, particle_fs);
+
+    for (int i = 0; i < PARTICLE_ATTRIBUTES; i++)
+        particle_attributes[i] = glGetAttribLocation(particle_shader.id, names[i]);
+
+    particle_transform = glGetUniformLocation(particle_shader.id, "transform");
+    particle_point_scale = glGetUniformLocation(particle_shader.id, "point_scale");
+    particle_end_scale = glGetUniformLocation(particle_shader.id, "end_scale");
+    particle_premultiplied = glGetUniformLocation(particle_shader.id, "premultiplied");
+    particle_color = glGetUniformLocation(particle_shader.id, "color");
+    particle_solid = glGetUniformLocation(particle_shader.id, "solid");
+
+    GLfloat range[2] = { 1, 1 };
+    glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, range);
+    particle_max_size = range[1];
+
+    debug("Particles up to %.0f pixels", particle_max_size);
+}
+
+// xorshift - -1 to 1
+float particle_random()
+{
+    particle_seed ^= particle_seed << 13;
+    particle_seed ^= particle_seed >> 17;
+    particle_seed ^= particle_seed << 5;
+
+    return (float)(particle_seed >> 8) / 8388608.f - 1.f;
+}
+
+// particle images load without trim - point sprites show the whole image
+TextureHandle acquire_particle_texture(const string filename)
+{
+    TextureOptions options = texture_options();
+
+    options.trim = false;
+    options.hull = 0;
+
+    return acquire_texture_options(filename, options);
+}
+
+Particles create_particles(const string filename, const int capacity)
+{
+    Particles result;
+
+    memset(&result, 0, sizeof(result));
+    result.capacity = capacity;
+    result.image = acquire_particle_texture(filename);
+    result.end_scale = 1.f;
+    result.x = (float*)counted_malloc(capacity * sizeof(float));
+    result.y = (float*)counted_malloc(capacity * sizeof(float));
+    result.velocity_x = (float*)counted_malloc(capacity * sizeof(float));
+    result.velocity_y = (float*)counted_malloc(capacity * sizeof(float));
+    result.life = (float*)counted_malloc(capacity * sizeof(float));
+    result.fade = (float*)counted_malloc(capacity * sizeof(float));
+    result.size = (float*)counted_malloc(capacity * sizeof(float));
+    result.color = (Color*)counted_malloc(capacity * sizeof(Color));
+
+    return result;
+}
+
+void free_particles(Particles* particles)
+{
+    free(particles->x);
+    free(particles->y);
+    free(particles->velocity_x);
+    free(particles->velocity_y);
+    free(particles->life);
+    free(particles->fade);
+    free(particles->size);
+    free(particles->color);
+    release_texture(particles->image);
+
+    memset(particles, 0, sizeof(Particles));
+}
+
+// returns the particles added - fewer when the system is full
+int emit_particles(Particles* particles, const Emitter* emitter, int count)
+{
+    if (count > particles->capacity - particles->count)
+        count = particles->capacity - particles->count;
+
+    for (int n = 0; n < count; n++)
+    {
+        int i = particles->count++;
+        float life = emitter->life + emitter->life_spread * particle_random();
+
+        life = life > 1.f ? life : 1.f;
+
+        particles->x[i] = emitter->position.x + emitter->area.x * particle_random();
+        particles->y[i] = emitter->position.y + emitter->area.y * particle_random();
+        particles->velocity_x[i] = emitter->velocity.x + emitter->velocity_spread.x * particle_random();
+        particles->velocity_y[i] = emitter->velocity.y + emitter->velocity_spread.y * particle_random();
+        particles->life[i] = life;
+        particles->fade[i] = 1.f / life;
+        particles->size[i] = emitter->size + emitter->size_spread * particle_random();
+        particles->color[i] = emitter->color;
+    }
+
+    return count;
+}
+
+// spawns what the rate owes for delta ticks
+void update_emitter(Particles* particles, Emitter* emitter, const float delta)
+{
+    emitter->owed += emitter->rate * delta * FRAME_TARGET / 1000.f;
+
+    int count = (int)emitter->owed;
+
+    emitter->owed -= count;
+    emit_particles(particles, emitter, count);
+}
+
+void remove_particle(Particles* particles, const int i)
+{
+    int last = --particles->count;
+
+    particles->x[i] = particles->x[last];
+    particles->y[i] = particles->y[last];
+    particles->velocity_x[i] = particles->velocity_x[last];
+    particles->velocity_y[i] = particles->velocity_y[last];
+    particles->life[i] = particles->life[last];
+    particles->fade[i] = particles->fade[last];
+    particles->size[i] = particles->size[last];
+    particles->color[i] = particles->color[last];
+}
+
+// moves every particle by delta ticks and removes the dead
+void update_particles(Particles* particles, const float delta)
+{
+    float elapsed = delta * FRAME_TARGET;
+    float seconds = elapsed / 1000.f;
+    float gravity_x = particles->gravity.x * seconds;
+    float gravity_y = particles->gravity.y * seconds;
+    float keep = 1.f - particles->drag * seconds;
+    float* x = particles->x;
+    float* y = particles->y;
+    float* velocity_x = particles->velocity_x;
+    float* velocity_y = particles->velocity_y;
+    float* life = particles->life;
+    int count = particles->count;
+    int i = 0;
+
+    keep = keep > 0 ? keep : 0;
+
+#ifdef USE_SSE2
+    __m128 step = _mm_set1_ps(seconds);
+    __m128 step_ms = _mm_set1_ps(elapsed);
+    __m128 pull_x = _mm_set1_ps(gravity_x);
+    __m128 pull_y = _mm_set1_ps(gravity_y);
+    __m128 damping = _mm_set1_ps(keep);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocity_x + i), pull_x), damping);
+        __m128 vy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(velocity_y + i), pull_y), damping);
+
+        _mm_storeu_ps(velocity_x + i, vx);
+        _mm_storeu_ps(velocity_y + i, vy);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vx, step)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(vy, step)));
+        _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), step_ms));
+    }
+#endif
+
+    // all of them without SSE2 - the last few with it
+    for (; i < count; i++)
+    {
+        velocity_x[i] = (velocity_x[i] + gravity_x) * keep;
+        velocity_y[i] = (velocity_y[i] + gravity_y) * keep;
+        x[i] += velocity_x[i] * seconds;
+        y[i] += velocity_y[i] * seconds;
+        life[i] -= elapsed;
+    }
+
+    for (i = 0; i < particles->count;)
+    {
+        if (life[i] <= 0)
+            remove_particle(particles, i); // the last one is checked next
+        else
+            i++;
+    }
+}
+
+// the debug views that replace the shader get flat points
+void set_particle_debug_view(const GLint color, const GLint solid)
+{
+    if (debug_view == DEBUG_VIEW_OVERDRAW)
+        glUniform4f(color, 1.f / 255.f, 0, 0, 0);
+
+    if (debug_view == DEBUG_VIEW_BATCHES)
+    {
+        float rgb[3];
+        batch_color(current_stats.draw_calls, rgb);
+        glUniform4f(color, rgb[0], rgb[1], rgb[2], 0.6f);
+    }
+
+    glUniform1f(solid, debug_view == DEBUG_VIEW_OVERDRAW || debug_view == DEBUG_VIEW_BATCHES ? 1.f : 0.f);
+}
+
+void draw_particles(const Particles* particles)
+{
+    TextureEntry* entry = texture_entry(particles->image);
+
+    if (entry == NULL || particles->count == 0)
+        return;
+
+    flush_sprites(); // keeps the draw order
+    touch_texture(particles->image);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glUseProgram(particle_shader.id);
+    current_stats.program_switches++;
+
+    glUniform4f(particle_transform, 2.f / DISPLAY_WIDTH, -2.f / DISPLAY_HEIGHT, -1.f, 1.f);
+    glUniform1f(particle_point_scale, (float)viewport[2] / DISPLAY_WIDTH);
+    glUniform1f(particle_end_scale, particles->end_scale);
+    glUniform1f(particle_premultiplied, PREMULTIPLIED_ALPHA ? 1.f : 0.f);
+
+    set_particle_debug_view(particle_color, particle_solid);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    current_stats.texture_binds++;
+
+    const float* columns[] = { particles->x, particles->y, particles->size };
+
+    for (int i = 0; i < 3; i++)
+        glVertexAttribPointer(particle_attributes[i], 1, GL_FLOAT, GL_FALSE, 0, columns[i]);
+
+    glVertexAttribPointer(particle_attributes[3], 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, particles->color);
+    glVertexAttribPointer(particle_attributes[4], 1, GL_FLOAT, GL_FALSE, 0, particles->life);
+    glVertexAttribPointer(particle_attributes[5], 1, GL_FLOAT, GL_FALSE, 0, particles->fade);
+
+    for (int i = 0; i < PARTICLE_ATTRIBUTES; i++)
+        glEnableVertexAttribArray(particle_attributes[i]);
+
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glEnable(GL_POINT_SPRITE);
+
+    glDrawArrays(GL_POINTS, 0, particles->count);
+    current_stats.draw_calls++;
+    current_stats.vertices += particles->count;
+
+    glDisable(GL_POINT_SPRITE);
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+
+    for (int i = 0; i < PARTICLE_ATTRIBUTES; i++)
+        glDisableVertexAttribArray(particle_attributes[i]);
+
+    glUseProgram(0);
+}
+
+//**************************************************
+// GPU PARTICLES
+//**************************************************
+
+// GpuParticles keep their state in a shader storage buffer - a compute
+// shader moves them and spawns the new ones, and the vertex shader reads
+// the buffer by gl_VertexID, so nothing goes back and forth with the cpu
+// the buffer is a ring: every update respawns the slots after the cursor,
+// dead ones wait there as points with no size and a full ring overwrites
+// the oldest, so the cpu never knows the count - size the capacity for
+// rate * life
+// needs COMPUTE_PARTICLES and a GL 4.3 driver that reads storage buffers in
+// vertex shaders - without them the same calls run a cpu Particles system
+
+#define GPU_EMITTERS 8 // per update_gpu_particles
+#define GPU_PARTICLE_GROUP 256 // compute shader local size
+
+typedef struct GpuParticles
+{
+    bool compute; // false runs fallback
+    int capacity;
+    int cursor; // ring slot of the next spawn
+    GLuint buffer; // 32 bytes a particle - see particle_cs
+    TextureHandle image;
+    Vector gravity; // pixels per second squared
+    float drag; // velocity lost per second - 0 to 1
+    float end_scale; // size multiplier at death
+    Particles fallback;
+} GpuParticles;
+
+const string particle_cs = "#version 430
+layout(local_size_x = 256) in;
+struct Particle
+{
+vec2 position;
+vec2 velocity;
+float life;
+float fade;
+float size;
+uint color;
+};
+layout(std430, binding = 0) buffer State { Particle particles[]; };
+uniform int capacity;
+uniform int spawn_start;
+uniform int spawn_count;
+uniform int emitter_count;
+uniform int emitter_end[8];
+uniform vec4 emitter_area[8];
+uniform vec4 emitter_velocity[8];
+uniform vec4 emitter_shape[8];
+uniform vec4 emitter_color[8];
+uniform vec4 motion;
+uniform int seed;
+uint state;
+float random()
+{
+state ^= state << 13;
+state ^= state >> 17;
+state ^= state << 5;
+return float(state >> 8) / 8388608.0 - 1.0;
+}
+void main()
+{
+int i = int(gl_GlobalInvocationID.x);
+if (i >= capacity) return;
+Particle p = particles[i];
+int offset = (i - spawn_start + capacity) % capacity;
+if (offset < spawn_count)
+{
+int e = 0;
+while (e < emitter_count - 1 && offset >= emitter_end[e]) e++;
+state = (uint(i) * 2654435761u) ^ uint(seed) | 1u;
+p.position = emitter_area[e].xy + emitter_area[e].zw * vec2(random(), random());
+p.velocity = emitter_velocity[e].xy + emitter_velocity[e].zw * vec2(random(), random());
+p.life = max(emitter_shape[e].x + emitter_shape[e].y * random(), 1.0);
+p.fade = 1.0 / p.life;
+p.size = emitter_shape[e].z + emitter_shape[e].w * random();
+p.color = packUnorm4x8(emitter_color[e]);
+}
+else if (p.life > 0.0)
+{
+p.velocity = (p.velocity + motion.xy) * motion.z;
+p.position += p.velocity * motion.w;
+p.life -= motion.w * 1000.0;
+}
+particles[i] = p;
+}";
+
+const string gpu_particle_vs = "#version 430
+struct Particle
+{
+vec2 position;
+vec2 velocity;
+float life;
+float fade;
+float size;
+uint color;
+};
+layout(std430, binding = 0) readonly buffer State { Particle particles[]; };
+uniform vec4 transform;
+uniform float point_scale;
+uniform float end_scale;
+uniform float premultiplied;
+out vec4 tint;
+void main()
+{
+Particle p = particles[gl_VertexID];
+float age = clamp(p.life * p.fade, 0.0, 1.0);
+vec4 color = unpackUnorm4x8(p.color);
+bool alive = p.life > 0.0;
+gl_Position = alive ? vec4(p.position * transform.xy + transform.zw, 0, 1) : vec4(2, 2, 2, 1);
+gl_PointSize = alive ? p.size * mix(end_scale, 1.0, age) * point_scale : 0.0;
+tint = vec4(color.rgb * mix(1.0, color.a * age, premultiplied), color.a * age);
+}";
+
+const string gpu_particle_fs = "#version 430
+in vec4 tint;
+uniform sampler2D texture0;
+uniform vec4 color;
+uniform float solid;
+out vec4 fragment;
+void main()
+{
+fragment = mix(texture(texture0, gl_PointCoord) * tint, color, solid);
+}";
+
+#define COMPUTE_UNIFORMS 11
+#define GPU_PARTICLE_UNIFORMS 6
+
+bool compute_particles; // compute shaders and vertex shader storage buffers work
+GLuint particle_compute; // program of particle_cs
+GLint compute_uniforms[COMPUTE_UNIFORMS]; // in compute_uniform_names order
+Shader gpu_particle_shader;
+GLint gpu_particle_uniforms[GPU_PARTICLE_UNIFORMS]; // transform, point_scale, end_scale, premultiplied, color, solid
+
+const string compute_uniform_names[COMPUTE_UNIFORMS] =
+{
+    "capacity", "spawn_start", "spawn_count", "emitter_count", "seed", "motion",
+    "emitter_end", "emitter_area", "emitter_velocity", "emitter_shape", "emitter_color"
+};
+
+// a compute program from a single shader - 0 when it fails
+word load_compute_program(const string source)
+{
+    int length = 0;
+    char msg[1024];
+    GLint success = 0;
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+
+    glShaderSource(shader, 1, &source, 0);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+
+    if (success != GL_TRUE)
+    {
+        glGetShaderInfoLog(shader, sizeof(msg), &length, msg);
+        debug("[CSHDR ID %i] Failed to compile compute shader...", shader);
+        debug("%s", msg);
+        glDeleteShader(shader);
+
+        return 0;
+    }
+
+    word program = glCreateProgram();
+    current_stats.shader_compiles++;
+
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (success != GL_TRUE)
+    {
+        glGetProgramInfoLog(program, sizeof(msg), &length, msg);
+        debug("[SHDR ID %i] Failed to link compute program...", program);
+        debug("%s", msg);
+        glDeleteProgram(program);
+
+        program = 0;
+    }
+    else debug("[SHDR ID %i] Compute program loaded successfully", program);
+
+    glDeleteShader(shader);
+
+    return program;
+}
+
+void load_gpu_particles()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    GLint vertex_blocks = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &major); // stays 0 on GL 2.0
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    compute_particles = COMPUTE_PARTICLES && (major > 4 || (major == 4 && minor >= 3)) &&
+        glDispatchCompute != NULL && glMemoryBarrier != NULL && glBindBufferBase != NULL && glUniform1iv != NULL;
+
+    // 4.3 allows 0 storage blocks in vertex shaders
+    if (compute_particles)
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertex_blocks);
+
+    if (vertex_blocks > 0)
+    {
+        particle_compute = load_compute_program(particle_cs);
+        gpu_particle_shader = load_shader_verbose(gpu_particle_vs, gpu_particle_fs);
+    }
+
+    compute_particles = particle_compute != 0 && gpu_particle_shader.id != 0;
+
+    if (compute_particles)
+    {
+        const string names[GPU_PARTICLE_UNIFORMS] =
+        {
+            "transform", "point_scale", "end_scale", "premultiplied", "color", "solid"
+        };
+
+        for (int i = 0; i < COMPUTE_UNIFORMS; i++)
+            compute_uniforms[i] = glGetUniformLocation(particle_compute, compute_uniform_names[i]);
+
+        for (int i = 0; i < GPU_PARTICLE_UNIFORMS; i++)
+            gpu_particle_uniforms[i] = glGetUniformLocation(gpu_particle_shader.id, names[i]);
+    }
+
+    debug("GL %i.%i - compute particles %s", major, minor, compute_particles ? "supported" : "not supported");
+}
+
+void unload_gpu_particles()
+{
+    if (particle_compute != 0)
+        glDeleteProgram(particle_compute);
+
+    if (gpu_particle_shader.id != 0)
+        unload_shader(gpu_particle_shader);
+
+    particle_compute = 0;
+    gpu_particle_shader.id = 0;
+}
+
+GpuParticles create_gpu_particles(const string filename, const int capacity)
+{
+    GpuParticles result;
+
+    memset(&result, 0, sizeof(result));
+    result.compute = compute_particles;
+    result.capacity = capacity;
+    result.end_scale = 1.f;
+
+    if (! result.compute)
+    {
+        result.fallback = create_particles(filename, capacity);
+        result.image = result.fallback.image;
+
+        return result;
+    }
+
+    // zeroed life is dead
+    long size = (long)capacity * 32;
+    byte* zeros = (byte*)counted_malloc(size);
+
+    memset(zeros, 0, size);
+
+    glGenBuffers(1, &result.buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, result.buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, zeros, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    Texture result;
+    free(zeros);
 
-    result.id = id;
-    result.position = VZero;
-    result.pivot = VZero;
-    result.width = width;
-    result.height = height;
-    result.rotation = 0;
-    result.flip_x = false;
-    result.flip_y = false;
-    result.scale = 1.0f;
-    result.source.x = 0;
-    result.source.y = 0;
-    result.source.width = width;
-    result.source.height = height;
+    result.image = acquire_particle_texture(filename);
 
     return result;
 }
 
-void unload_texture(Texture texture)
+void free_gpu_particles(GpuParticles* particles)
 {
-    if (texture.id != 0)
-	{
-		glDeleteTextures(1, &texture.id);
+    if (particles->compute)
+    {
+        glDeleteBuffers(1, &particles->buffer);
+        release_texture(particles->image);
+    }
+    else free_particles(&particles->fallback);
 
-		debug("[TEX ID %i] Unloaded texture data from VRAM (GPU)", texture.id);
-		texture.id = 0;
-	}
+    memset(particles, 0, sizeof(GpuParticles));
 }
 
-word load_shader_program(const string vertex_str, const string fragment_str)
-{   
-    word program = 0;
-    int maxLength = 0;
-    int length;
-    char msg[1024];
+// spawns what the emitters owe for delta ticks and moves every particle
+// the first GPU_EMITTERS emitters count
+void update_gpu_particles(GpuParticles* particles, Emitter* emitters, int emitter_count, const float delta)
+{
+    if (emitter_count > GPU_EMITTERS)
+        emitter_count = GPU_EMITTERS;
 
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    if (! particles->compute)
+    {
+        particles->fallback.gravity = particles->gravity;
+        particles->fallback.drag = particles->drag;
+        particles->fallback.end_scale = particles->end_scale;
 
-    glShaderSource(vertex_shader, 1, &vertex_str, 0);
-    glShaderSource(fragment_shader, 1, &fragment_str, 0);
+        for (int i = 0; i < emitter_count; i++)
+            update_emitter(&particles->fallback, &emitters[i], delta);
 
-    GLint success = 0;
+        update_particles(&particles->fallback, delta);
 
-    glCompileShader(vertex_shader);
+        return;
+    }
 
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
+    float seconds = delta * FRAME_TARGET / 1000.f;
+    float keep = 1.f - particles->drag * seconds;
+    GLint end[GPU_EMITTERS];
+    GLfloat area[GPU_EMITTERS][4];
+    GLfloat velocity[GPU_EMITTERS][4];
+    GLfloat shape[GPU_EMITTERS][4];
+    GLfloat color[GPU_EMITTERS][4];
+    int spawned = 0;
 
-    if (success != GL_TRUE)
+    for (int i = 0; i < emitter_count; i++)
     {
-        debug("[VSHDR ID %i] Failed to compile vertex shader...", vertex_shader);
+        Emitter* emitter = &emitters[i];
+
+        emitter->owed += emitter->rate * seconds;
+
+        int count = (int)emitter->owed;
+
+        emitter->owed -= count;
+
+        if (count > particles->capacity - spawned)
+            count = particles->capacity - spawned;
+
+        spawned += count;
+        end[i] = spawned;
+
+        area[i][0] = emitter->position.x;
+        area[i][1] = emitter->position.y;
+        area[i][2] = emitter->area.x;
+        area[i][3] = emitter->area.y;
+        velocity[i][0] = emitter->velocity.x;
+        velocity[i][1] = emitter->velocity.y;
+        velocity[i][2] = emitter->velocity_spread.x;
+        velocity[i][3] = emitter->velocity_spread.y;
+        shape[i][0] = emitter->life;
+        shape[i][1] = emitter->life_spread;
+        shape[i][2] = emitter->size;
+        shape[i][3] = emitter->size_spread;
+        color[i][0] = emitter->color.r / 255.f;
+        color[i][1] = emitter->color.g / 255.f;
+        color[i][2] = emitter->color.b / 255.f;
+        color[i][3] = emitter->color.a / 255.f;
+    }
 
-        glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &maxLength);        
+    glUseProgram(particle_compute);
+    current_stats.program_switches++;
 
-        glGetShaderInfoLog(vertex_shader, maxLength, &length, msg);
+    glUniform1i(compute_uniforms[0], particles->capacity);
+    glUniform1i(compute_uniforms[1], particles->cursor);
+    glUniform1i(compute_uniforms[2], spawned);
+    glUniform1i(compute_uniforms[3], emitter_count);
+    glUniform1i(compute_uniforms[4], (int)(particle_random() * 8388608.f));
+    glUniform4f(compute_uniforms[5], particles->gravity.x * seconds, particles->gravity.y * seconds, keep > 0 ? keep : 0, seconds);
 
-        debug("%s", msg);
+    if (emitter_count > 0)
+    {
+        glUniform1iv(compute_uniforms[6], emitter_count, end);
+        glUniform4fv(compute_uniforms[7], emitter_count, &area[0][0]);
+        glUniform4fv(compute_uniforms[8], emitter_count, &velocity[0][0]);
+        glUniform4fv(compute_uniforms[9], emitter_count, &shape[0][0]);
+        glUniform4fv(compute_uniforms[10], emitter_count, &color[0][0]);
     }
-    else
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles->buffer);
+    glDispatchCompute((particles->capacity + GPU_PARTICLE_GROUP - 1) / GPU_PARTICLE_GROUP, 1, 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glUseProgram(0);
+
+    // the draw reads what the dispatch wrote
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    particles->cursor = (particles->cursor + spawned) % particles->capacity;
+}
+
+// every slot of the ring is a point - the dead ones have no size
+void draw_gpu_particles(const GpuParticles* particles)
+{
+    if (! particles->compute)
     {
-        debug("[VSHDR ID %i] Vertex shader compiled successfully", vertex_shader);
+        draw_particles(&particles->fallback);
+        return;
     }
 
-    glCompileShader(fragment_shader);
+    TextureEntry* entry = texture_entry(particles->image);
 
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
+    if (entry == NULL)
+        return;
 
-    if (success != GL_TRUE)
+    flush_sprites(); // keeps the draw order
+    touch_texture(particles->image);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glUseProgram(gpu_particle_shader.id);
+    current_stats.program_switches++;
+
+    glUniform4f(gpu_particle_uniforms[0], 2.f / DISPLAY_WIDTH, -2.f / DISPLAY_HEIGHT, -1.f, 1.f);
+    glUniform1f(gpu_particle_uniforms[1], (float)viewport[2] / DISPLAY_WIDTH);
+    glUniform1f(gpu_particle_uniforms[2], particles->end_scale);
+    glUniform1f(gpu_particle_uniforms[3], PREMULTIPLIED_ALPHA ? 1.f : 0.f);
+    set_particle_debug_view(gpu_particle_uniforms[4], gpu_particle_uniforms[5]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, entry->id);
+    current_stats.texture_binds++;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles->buffer);
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glEnable(GL_POINT_SPRITE);
+
+    glDrawArrays(GL_POINTS, 0, particles->capacity);
+    current_stats.draw_calls++;
+    current_stats.vertices += particles->capacity;
+
+    glDisable(GL_POINT_SPRITE);
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+
+    glUseProgram(0);
+}
+
+//**************************************************
+// ENTITIES
+//**************************************************
+
+// entities are rows of archetype tables - one table per set of components,
+// each component a column of its own, so a query walks plain arrays of
+// only the components it asks for
+// components are registered with their size and get a bit of the masks:
+//     int position = COMPONENT(Vector);
+//     Entity e = create_entity(MASK(position) | MASK(velocity));
+//     Query q = query(MASK(position) | MASK(velocity), 0);
+//     for (Archetype* table; (table = next_archetype(&q)) != NULL;)
+//         Vector* p = column(table, position); ... for table->count rows
+// handles stay valid while rows move and go stale when the entity dies -
+// component pointers only until the next create, destroy or mask change
+// destroying while a query walks a table swaps the last row in, so walk
+// that table backwards or collect_entities first
+
+#define MAX_ENTITIES 262144
+#define ENTITY_INDEX_BITS 18 // of the handle - the rest is the generation
+#define MAX_COMPONENTS 32 // bits of a ComponentMask
+#define MAX_ARCHETYPES 64
+#define MIN_ARCHETYPE_ROWS 64
+
+typedef uint Entity; // handle - 0 is none
+typedef uint ComponentMask;
+
+#define MASK(component) (1u << (component))
+#define COMPONENT(type) add_component(#type, sizeof(type))
+
+typedef struct Archetype
+{
+    ComponentMask mask;
+    int count;
+    int capacity;
+    Entity* entities; // handle of every row
+    void* columns[MAX_COMPONENTS]; // NULL for components out of the mask
+} Archetype;
+
+typedef struct Query
+{
+    ComponentMask all; // tables with every one of these
+    ComponentMask none; // and none of these
+    int next; // archetype to look at
+} Query;
+
+int component_sizes[MAX_COMPONENTS];
+string component_names[MAX_COMPONENTS];
+int component_count;
+Archetype archetypes[MAX_ARCHETYPES];
+int archetype_count;
+
+// handle slots - index on the low bits of a handle
+byte entity_archetype[MAX_ENTITIES];
+uint entity_row[MAX_ENTITIES];
+word entity_generation[MAX_ENTITIES];
+uint entity_free[MAX_ENTITIES]; // stack of free slots
+int entity_free_count;
+int entity_count;
+
+void load_entities()
+{
+    for (int i = 0; i < MAX_ENTITIES; i++)
+        entity_free[i] = MAX_ENTITIES - 1 - i;
+
+    entity_free_count = MAX_ENTITIES;
+    entity_count = 0;
+}
+
+// frees the tables - registered components stay
+void unload_entities()
+{
+    for (int a = 0; a < archetype_count; a++)
     {
-        debug("[FSHDR ID %i] Failed to compile fragment shader...", fragment_shader);
+        free(archetypes[a].entities);
 
-        glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &maxLength);
-        glGetShaderInfoLog(fragment_shader, maxLength, &length, msg);
+        for (int c = 0; c < MAX_COMPONENTS; c++)
+            free(archetypes[a].columns[c]);
+    }
 
-        debug("%s", msg);
+    memset(archetypes, 0, sizeof(archetypes));
+    archetype_count = 0;
+    load_entities();
+}
 
+// returns the component - its bit is MASK(component), -1 when full
+int add_component(const string name, const int size)
+{
+    if (component_count == MAX_COMPONENTS)
+    {
+        debug("Component %s not added - %i components", name, MAX_COMPONENTS);
+        return -1;
     }
-    else debug("[FSHDR ID %i] Fragment shader compiled successfully", fragment_shader);
 
-    program = glCreateProgram();
+    component_names[component_count] = name;
+    component_sizes[component_count] = size;
 
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
+    return component_count++;
+}
 
-    glLinkProgram(program);
+// never 0 so no handle is 0
+uint entity_tag(const uint slot)
+{
+    return entity_generation[slot] % ((1 << (32 - ENTITY_INDEX_BITS)) - 1) + 1;
+}
 
-    // NOTE: All uniform variables are initialized to 0 when a program links
+// slot of a live handle - -1 when it died
+int entity_slot(const Entity entity)
+{
+    uint slot = entity & (MAX_ENTITIES - 1);
 
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (entity == 0 || entity_tag(slot) != entity >> ENTITY_INDEX_BITS)
+        return -1;
 
-    if (success != GL_TRUE)
+    return slot;
+}
+
+bool entity_alive(const Entity entity)
+{
+    return entity_slot(entity) != -1;
+}
+
+// finds the table of a mask or makes an empty one - NULL when full
+Archetype* get_archetype(const ComponentMask mask)
+{
+    for (int a = 0; a < archetype_count; a++)
+        if (archetypes[a].mask == mask)
+            return &archetypes[a];
+
+    if (archetype_count == MAX_ARCHETYPES)
     {
-        debug("[SHDR ID %i] Failed to link shader program...", program);
+        debug("Archetype %08x not added - %i archetypes", mask, MAX_ARCHETYPES);
+        return NULL;
+    }
 
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
-        glGetProgramInfoLog(program, maxLength, &length, msg);
+    Archetype* result = &archetypes[archetype_count++];
 
-        debug("%s", msg);
+    memset(result, 0, sizeof(Archetype));
+    result->mask = mask;
 
-        glDeleteProgram(program);
+    return result;
+}
 
-        program = 0;
-    }
-    else debug("[SHDR ID %i] Shader program loaded successfully", program);
+// room for count more rows - columns double so bulk creates grow once
+void reserve_rows(Archetype* table, const int count)
+{
+    if (table->count + count <= table->capacity)
+        return;
 
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+    int capacity = table->capacity > 0 ? table->capacity : MIN_ARCHETYPE_ROWS;
 
-    return program;
+    while (capacity < table->count + count)
+        capacity *= 2;
+
+    table->entities = (Entity*)counted_realloc(table->entities, capacity * sizeof(Entity));
+
+    for (int c = 0; c < component_count; c++)
+        if (table->mask & MASK(c))
+            table->columns[c] = counted_realloc(table->columns[c], (long)capacity * component_sizes[c]);
+
+    table->capacity = capacity;
 }
 
-Shader load_shader_verbose(const string vs, const string fs)
+void* column(const Archetype* table, const int component)
 {
-    Shader result;
+    return table->columns[component];
+}
 
-    result.id = load_shader_program(vs, fs);
+// count entities with zeroed components on consecutive rows - returns the
+// first row so the columns can be filled in bulk, -1 when there is no room
+// handles go to entities when it isn't NULL
+int create_entities(const ComponentMask mask, const int count, Entity* entities)
+{
+    Archetype* table = get_archetype(mask);
 
-    if (result.id != 0)
+    if (table == NULL || count > entity_free_count)
     {
-        result.vertex_position = glGetAttribLocation(result.id, "vertex_position");
-        result.texture_position = glGetAttribLocation(result.id, "texture_position");
-        
-        debug("[SHDR ID %i] shader locations set", result.id);
+        debug("%i entities not created - %i alive", count, entity_count);
+        return -1;
     }
-    
+
+    reserve_rows(table, count);
+
+    int first = table->count;
+
+    for (int c = 0; c < component_count; c++)
+        if (mask & MASK(c))
+            memset((byte*)table->columns[c] + (long)first * component_sizes[c], 0, (long)count * component_sizes[c]);
+
+    for (int i = 0; i < count; i++)
+    {
+        uint slot = entity_free[--entity_free_count];
+        Entity entity = entity_tag(slot) << ENTITY_INDEX_BITS | slot;
+
+        entity_archetype[slot] = table - archetypes;
+        entity_row[slot] = first + i;
+        table->entities[first + i] = entity;
+
+        if (entities != NULL)
+            entities[i] = entity;
+    }
+
+    table->count += count;
+    entity_count += count;
+
+    return first;
+}
+
+Entity create_entity(const ComponentMask mask)
+{
+    Entity result = 0;
+
+    create_entities(mask, 1, &result);
+
     return result;
 }
 
-Shader load_shader(const string vs_filename, const string fs_filename)
+// last row into the freed one
+void remove_row(Archetype* table, const int row)
 {
-    string vertex_str = load_text(vs_filename);
-    string fragment_str = load_text(fs_filename);
+    int last = --table->count;
 
-    Shader result = load_shader_verbose(vertex_str, fragment_str);
+    if (row != last)
+    {
+        for (int c = 0; c < component_count; c++)
+            if (table->mask & MASK(c))
+                memcpy((byte*)table->columns[c] + (long)row * component_sizes[c],
+                    (byte*)table->columns[c] + (long)last * component_sizes[c], component_sizes[c]);
 
-    free(vertex_str);
-    free(fragment_str);
+        table->entities[row] = table->entities[last];
+        entity_row[table->entities[row] & (MAX_ENTITIES - 1)] = row;
+    }
+}
+
+void destroy_entity(const Entity entity)
+{
+    int slot = entity_slot(entity);
+
+    if (slot == -1)
+        return;
+
+    remove_row(&archetypes[entity_archetype[slot]], entity_row[slot]);
+
+    entity_generation[slot]++;
+    entity_free[entity_free_count++] = slot;
+    entity_count--;
+}
+
+void destroy_entities(const Entity* entities, const int count)
+{
+    for (int i = 0; i < count; i++)
+        destroy_entity(entities[i]);
+}
+
+// every entity of every table - the columns keep their memory for the next ones
+void destroy_all_entities()
+{
+    for (int a = 0; a < archetype_count; a++)
+    {
+        Archetype* table = &archetypes[a];
+
+        for (int row = 0; row < table->count; row++)
+        {
+            uint slot = table->entities[row] & (MAX_ENTITIES - 1);
+
+            entity_generation[slot]++;
+            entity_free[entity_free_count++] = slot;
+        }
+
+        table->count = 0;
+    }
+
+    entity_count = 0;
+}
+
+// NULL when the entity died or hasn't the component
+void* get_component(const Entity entity, const int component)
+{
+    int slot = entity_slot(entity);
+
+    if (slot == -1)
+        return NULL;
+
+    Archetype* table = &archetypes[entity_archetype[slot]];
+
+    if (! (table->mask & MASK(component)))
+        return NULL;
+
+    return (byte*)table->columns[component] + (long)entity_row[slot] * component_sizes[component];
+}
+
+ComponentMask entity_mask(const Entity entity)
+{
+    int slot = entity_slot(entity);
+
+    return slot == -1 ? 0 : archetypes[entity_archetype[slot]].mask;
+}
+
+// moves the entity to the table of mask - shared components are copied,
+// new ones zeroed, the handle stays the same
+void set_entity_mask(const Entity entity, const ComponentMask mask)
+{
+    int slot = entity_slot(entity);
+
+    if (slot == -1)
+        return;
+
+    Archetype* from = &archetypes[entity_archetype[slot]];
+
+    if (from->mask == mask)
+        return;
+
+    Archetype* to = get_archetype(mask);
+
+    if (to == NULL)
+        return;
+
+    reserve_rows(to, 1);
+
+    int row = entity_row[slot];
+    int new_row = to->count++;
+
+    for (int c = 0; c < component_count; c++)
+    {
+        if (! (mask & MASK(c)))
+            continue;
+
+        byte* target = (byte*)to->columns[c] + (long)new_row * component_sizes[c];
+
+        if (from->mask & MASK(c))
+            memcpy(target, (byte*)from->columns[c] + (long)row * component_sizes[c], component_sizes[c]);
+        else
+            memset(target, 0, component_sizes[c]);
+    }
+
+    to->entities[new_row] = entity;
+    remove_row(from, row);
+
+    entity_archetype[slot] = to - archetypes;
+    entity_row[slot] = new_row;
+}
+
+void add_components(const Entity entity, const ComponentMask mask)
+{
+    set_entity_mask(entity, entity_mask(entity) | mask);
+}
+
+void remove_components(const Entity entity, const ComponentMask mask)
+{
+    set_entity_mask(entity, entity_mask(entity) & ~mask);
+}
+
+Query query(const ComponentMask all, const ComponentMask none)
+{
+    Query result;
+
+    result.all = all;
+    result.none = none;
+    result.next = 0;
 
     return result;
 }
 
-void unload_shader(Shader shader)
+// the next table with rows the query matches - NULL at the end
+Archetype* next_archetype(Query* query)
 {
-    glUseProgram(0);
-    glDeleteProgram(shader.id);
+    while (query->next < archetype_count)
+    {
+        Archetype* table = &archetypes[query->next++];
 
-    shader.id = 0;
+        if ((table->mask & query->all) == query->all && ! (table->mask & query->none) && table->count > 0)
+            return table;
+    }
+
+    return NULL;
 }
 
-void draw(const Texture texture)
+// handles of every entity with all and without none, in the frame arena -
+// NULL with a count of 0 when it doesn't fit
+Entity* collect_entities(const ComponentMask all, const ComponentMask none, int* count)
 {
-	Quad destination = calculate_quad(texture);
-	
-	// top left
-	square_vertices[0] = translate_x(destination.top_left.x);
-	square_vertices[1] = translate_y(destination.top_left.y);
-
-	// top right
-	square_vertices[2] = translate_x(destination.top_right.x);
-	square_vertices[3] = translate_y(destination.top_right.y);
-
-    // bottom left
-    square_vertices[4] = translate_x(destination.bottom_left.x);
-    square_vertices[5] = translate_y(destination.bottom_left.y);
-
-    // bottom right
-    square_vertices[6] = translate_x(destination.bottom_right.x);
-    square_vertices[7] = translate_y(destination.bottom_right.y);
-
-	//////
-	// top left
-	texture_vertices[0] = (float)texture.source.x / texture.width;
-	texture_vertices[1] = (float)texture.source.y / texture.height;
-
-	//top right
-	texture_vertices[2] =
-		(float)(texture.source.x + texture.source.width) /
-		texture.width;
-	texture_vertices[3] = (float)texture.source.y / texture.height;
-
-    // bottom left
-    texture_vertices[4] = (float)texture.source.x / texture.width;
-    texture_vertices[5] =
-        (float)(texture.source.y + texture.source.height) /
-        texture.height;
-
-	// bottom right
-	texture_vertices[6] =
-		(float)(texture.source.x + texture.source.width) /
-		texture.width;
-	texture_vertices[7] =
-		(float)(texture.source.y + texture.source.height) /
-		texture.height;
-
-
-    /*
-    for (int h = 0; h < 8; h++)
-        debug("square_vertices v: %f", square_vertices[h]);
-
-	for (int h = 0; h < 8; h++)
-		debug("texture_vertices v: %f", texture_vertices[h]);
-    */
-
-	// Set the shader
-	glUseProgram(current_shader.id);
-
-	// Load the vertex data (vec2)
-	glVertexAttribPointer(
-		current_shader.vertex_position,
-		2,
-		GL_FLOAT,
-		GL_FALSE,
-		0,
-		square_vertices);
-	glEnableVertexAttribArray(current_shader.vertex_position);
-
-	// Load the texture coordinates (vec2)
-	glVertexAttribPointer(
-		current_shader.texture_position,
-		2,
-		GL_FLOAT,
-		GL_FALSE,
-		0, texture_vertices);
-	glEnableVertexAttribArray(current_shader.texture_position);
-
-	// load texture
-	glBindTexture(GL_TEXTURE_2D, texture.id);
-
-	// finally draw
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-	glDisableVertexAttribArray(current_shader.vertex_position);
-	glDisableVertexAttribArray(current_shader.texture_position);
-
-	glUseProgram(0); // Unbind shader program
+    Query matching = query(all, none);
+    Archetype* table;
+    int total = 0;
+
+    while ((table = next_archetype(&matching)) != NULL)
+        total += table->count;
+
+    Entity* result = (Entity*)frame_alloc(total * sizeof(Entity));
+
+    *count = 0;
+
+    if (result == NULL)
+        return NULL;
+
+    matching = query(all, none);
+
+    while ((table = next_archetype(&matching)) != NULL)
+    {
+        memcpy(result + *count, table->entities, table->count * sizeof(Entity));
+        *count += table->count;
+    }
+
+    return result;
 }
 
 //**************************************************
@@ -970,7 +6646,22 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
               0
             };
 
-    		opengl_context = wglCreateContextAttribsARB(device_context, 0, attributes_version);
+            // compatibility profile - the sprite batch keeps its client side arrays
+            int attributes_compute[] =
+            {
+              WGL_CONTEXT_MAJOR_VERSION_ARB, 4,
+              WGL_CONTEXT_MINOR_VERSION_ARB, 3,
+              WGL_CONTEXT_PROFILE_MASK_ARB, WGL_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB,
+              0
+            };
+
+            opengl_context = NULL;
+
+            if (COMPUTE_PARTICLES)
+                opengl_context = wglCreateContextAttribsARB(device_context, 0, attributes_compute);
+
+            if (opengl_context == NULL)
+    		    opengl_context = wglCreateContextAttribsARB(device_context, 0, attributes_version);
     	    wglMakeCurrent(device_context, opengl_context);
 
             wglSwapIntervalEXT(1); // VSYNC ON
@@ -978,7 +6669,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
             glDisable(GL_DEPTH_TEST);
             glEnable(GL_BLEND);
             glEnable(GL_TEXTURE0);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glBlendFunc(PREMULTIPLIED_ALPHA ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
 
             ShowCursor(SHOW_CURSOR);
@@ -1001,6 +6692,12 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 			
 			if (VK_ESCAPE == wParam)
                 DestroyWindow(hwnd);
+
+			if (DEBUG && VK_F1 == wParam)
+				next_debug_view();
+
+			if (DEBUG && VK_F2 == wParam)
+				toggle_stats();
 		}
         break;
 
@@ -1097,8 +6794,30 @@ int APIENTRY WinMain(
 	if (! FULL_SCREEN)
 		center_window(hwnd);
 	
+    load_arenas();
+
     base_shader = load_shader_verbose(direct_vs, direct_fs);
     current_shader = base_shader;
+
+    palette_shader = load_shader_verbose(direct_vs, palette_fs);
+    glUseProgram(palette_shader.id);
+    glUniform1i(glGetUniformLocation(palette_shader.id, "palette"), 1);
+    glUseProgram(0);
+
+    load_multi_texture();
+    load_texture_arrays();
+    load_tilemap_shader();
+    load_chunk_shaders();
+    load_tweens();
+    load_entities();
+    load_particles();
+    load_gpu_particles();
+
+    if (DEBUG)
+        load_debug_views();
+
+    load_gpu_timers();
+
     game_init(); // after window created and opengl context	
 
     const int SKIP_TICKS = 1000 / FRAMES_PER_SECOND;
@@ -1118,16 +6837,36 @@ int APIENTRY WinMain(
 		if (msg.message == WM_QUIT)
 			quit = true;
 		
+        begin_gpu_pass(GPU_PASS_CLEAR);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(0.14f, 0.14f, 0.14f, 0); // #2e2e2e
+        debug_view_begin_frame();
 
+        begin_gpu_pass(GPU_PASS_GAME);
+        double tick_start = now_ms();
         game_tick(1.f); // delta time
+        flush_sprites();
+        current_stats.tick_ms = now_ms() - tick_start;
+
+        if (debug_view == DEBUG_VIEW_OVERDRAW)
+            begin_gpu_pass(GPU_PASS_DEBUG_VIEW);
+        debug_view_end_frame();
+
+        if (show_stats)
+            begin_gpu_pass(GPU_PASS_OVERLAY);
+        draw_stats_overlay();
+        read_gpu_timers();
 
+        double present_start = now_ms();
         glFinish();
         SwapBuffers(device_context);
+        current_stats.present_ms = now_ms() - present_start;
+        end_frame_stats();
+        end_frame_arenas();
 
 		memset(&released_keys, 0, sizeof(released_keys));
 		key_any = false;
+		frame_number++;
 		
         next_game_tick += SKIP_TICKS;
         sleep_time = next_game_tick - GetTickCount();
@@ -1139,7 +6878,32 @@ int APIENTRY WinMain(
     }
 
     game_terminate();
+    unload_shader(palette_shader);
+
+    if (multi_shader.id != 0)
+        unload_shader(multi_shader);
+
+    if (array_shader.id != 0)
+        unload_shader(array_shader);
+
+    unload_shader(tilemap_shader);
+    unload_chunk_shaders();
+    unload_shader(particle_shader);
+    unload_gpu_particles();
+    unload_entities();
+
+    if (solid_shader.id != 0) // DEBUG or set_debug_view
+        unload_debug_views();
+
+    unload_gpu_timers();
     unload_shader(base_shader);
+    unload_arenas();
+
+    if (DEBUG && textures_alive() > 0)
+    {
+        debug("Textures still loaded at exit:");
+        log_textures();
+    }
 
     return msg.wParam;
 }
@@ -100,6 +100,8 @@ void game_tick(const float delta)
 	if (current_scene != scene)
 		change_scene();
 
+	update_tweens(delta);
+
 	switch (current_scene)
 	{
 	case 1:
@@ -3,8 +3,7 @@
 Texture over_text;
 Texture over_any;
 
-float over_time;
-bool over_show_any;
+Tween over_blink;
 
 void over_init()
 {
@@ -28,8 +27,11 @@ void over_init()
 	over_any.position.x = 35;
 	over_any.position.y = 1027;
 
-	over_time = 0.f;
-	over_show_any = false;
+	// hidden and shown for BLINK_TIME each - intro_init falls through to here too
+	cancel_tweens_of(&over_any.alpha);
+	over_any.alpha = 0;
+	over_blink = tween_byte(&over_any.alpha, 255, BLINK_TIME, EASE_STEP);
+	set_tween_repeat(over_blink, -1, true);
 }
 
 void over_tick(const float delta)
@@ -37,21 +39,13 @@ void over_tick(const float delta)
 	if (key_any)
 		current_scene = 1;
 
-	over_time += delta * FRAME_TARGET;
-	if (over_time > BLINK_TIME)
-	{
-		over_show_any = !over_show_any;
-		over_time = 0.f;
-	}
-		
 	draw(over_text);
-
-	if (over_show_any)
-		draw(over_any);
+	draw(over_any);
 }
 
 void over_terminate()
 {
+	cancel_tween(over_blink);
 	unload_texture(over_any);	
 	unload_texture(over_text);
 	//unload_texture(over_background);
@@ -0,0 +1,255 @@
+//**************************************************
+// QOI - Quite OK Image format
+// https://qoiformat.org/qoi-specification.pdf
+// decodes to RGBA and encodes from RGBA
+//**************************************************
+
+#ifndef QOI_H
+#define QOI_H
+
+#include <stdlib.h>
+
+#define QOI_OP_INDEX 0x00 // 00xxxxxx
+#define QOI_OP_DIFF  0x40 // 01xxxxxx
+#define QOI_OP_LUMA  0x80 // 10xxxxxx
+#define QOI_OP_RUN   0xc0 // 11xxxxxx
+#define QOI_OP_RGB   0xfe // 11111110
+#define QOI_OP_RGBA  0xff // 11111111
+#define QOI_MASK_2   0xc0
+
+#define QOI_MAGIC 0x716f6966 // qoif
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+#define QOI_PIXELS_MAX 400000000
+
+#define QOI_HASH(p) ((p)[0] * 3 + (p)[1] * 5 + (p)[2] * 7 + (p)[3] * 11)
+
+unsigned int qoi_read_32(const unsigned char* bytes, int* p)
+{
+	unsigned int a = bytes[(*p)++];
+	unsigned int b = bytes[(*p)++];
+	unsigned int c = bytes[(*p)++];
+	unsigned int d = bytes[(*p)++];
+
+	return a << 24 | b << 16 | c << 8 | d;
+}
+
+void qoi_write_32(unsigned char* bytes, int* p, const unsigned int value)
+{
+	bytes[(*p)++] = (0xff000000 & value) >> 24;
+	bytes[(*p)++] = (0x00ff0000 & value) >> 16;
+	bytes[(*p)++] = (0x0000ff00 & value) >> 8;
+	bytes[(*p)++] = (0x000000ff & value);
+}
+
+// returns malloc'ed RGBA pixels or NULL
+unsigned char* qoi_decode(const void* data, const int size, unsigned int* width, unsigned int* height)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	int p = 0;
+
+	if (data == NULL || size < QOI_HEADER_SIZE + QOI_PADDING_SIZE)
+		return NULL;
+
+	unsigned int magic = qoi_read_32(bytes, &p);
+	unsigned int w = qoi_read_32(bytes, &p);
+	unsigned int h = qoi_read_32(bytes, &p);
+	p += 2; // channels and colorspace - always decoded to RGBA
+
+	if (magic != QOI_MAGIC || w == 0 || h == 0 || h >= QOI_PIXELS_MAX / w)
+		return NULL;
+
+	int pixels_length = w * h * 4;
+	unsigned char* pixels = (unsigned char*)malloc(pixels_length);
+
+	if (pixels == NULL)
+		return NULL;
+
+	unsigned char index[64 * 4] = { 0 };
+	unsigned char px[4] = { 0, 0, 0, 255 };
+	int run = 0;
+	int chunks_length = size - QOI_PADDING_SIZE;
+
+	for (int px_pos = 0; px_pos < pixels_length; px_pos += 4)
+	{
+		if (run > 0)
+		{
+			run--;
+		}
+		else if (p < chunks_length)
+		{
+			int b1 = bytes[p++];
+
+			if (b1 == QOI_OP_RGB)
+			{
+				px[0] = bytes[p++];
+				px[1] = bytes[p++];
+				px[2] = bytes[p++];
+			}
+			else if (b1 == QOI_OP_RGBA)
+			{
+				px[0] = bytes[p++];
+				px[1] = bytes[p++];
+				px[2] = bytes[p++];
+				px[3] = bytes[p++];
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX)
+			{
+				const unsigned char* entry = index + b1 * 4;
+				px[0] = entry[0];
+				px[1] = entry[1];
+				px[2] = entry[2];
+				px[3] = entry[3];
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF)
+			{
+				px[0] += ((b1 >> 4) & 0x03) - 2;
+				px[1] += ((b1 >> 2) & 0x03) - 2;
+				px[2] += (b1 & 0x03) - 2;
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA)
+			{
+				int b2 = bytes[p++];
+				int vg = (b1 & 0x3f) - 32;
+				px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+				px[1] += vg;
+				px[2] += vg - 8 + (b2 & 0x0f);
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_RUN)
+			{
+				run = (b1 & 0x3f);
+			}
+
+			unsigned char* entry = index + (QOI_HASH(px) % 64) * 4;
+			entry[0] = px[0];
+			entry[1] = px[1];
+			entry[2] = px[2];
+			entry[3] = px[3];
+		}
+
+		pixels[px_pos + 0] = px[0];
+		pixels[px_pos + 1] = px[1];
+		pixels[px_pos + 2] = px[2];
+		pixels[px_pos + 3] = px[3];
+	}
+
+	*width = w;
+	*height = h;
+
+	return pixels;
+}
+
+// returns malloc'ed qoi file data or NULL - pixels are RGBA
+void* qoi_encode(const unsigned char* pixels, const unsigned int width, const unsigned int height, int* out_length)
+{
+	if (pixels == NULL || width == 0 || height == 0 || height >= QOI_PIXELS_MAX / width)
+		return NULL;
+
+	int max_size = width * height * 5 + QOI_HEADER_SIZE + QOI_PADDING_SIZE;
+	unsigned char* bytes = (unsigned char*)malloc(max_size);
+	int p = 0;
+
+	if (bytes == NULL)
+		return NULL;
+
+	qoi_write_32(bytes, &p, QOI_MAGIC);
+	qoi_write_32(bytes, &p, width);
+	qoi_write_32(bytes, &p, height);
+	bytes[p++] = 4; // RGBA
+	bytes[p++] = 0; // sRGB with linear alpha
+
+	unsigned char index[64 * 4] = { 0 };
+	unsigned char px_prev[4] = { 0, 0, 0, 255 };
+	int run = 0;
+	int pixels_length = width * height * 4;
+	int px_end = pixels_length - 4;
+
+	for (int px_pos = 0; px_pos < pixels_length; px_pos += 4)
+	{
+		const unsigned char* px = pixels + px_pos;
+
+		if (px[0] == px_prev[0] && px[1] == px_prev[1] && px[2] == px_prev[2] && px[3] == px_prev[3])
+		{
+			run++;
+
+			if (run == 62 || px_pos == px_end)
+			{
+				bytes[p++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+
+			continue;
+		}
+
+		if (run > 0)
+		{
+			bytes[p++] = QOI_OP_RUN | (run - 1);
+			run = 0;
+		}
+
+		int index_pos = QOI_HASH(px) % 64;
+		unsigned char* entry = index + index_pos * 4;
+
+		if (entry[0] == px[0] && entry[1] == px[1] && entry[2] == px[2] && entry[3] == px[3])
+		{
+			bytes[p++] = QOI_OP_INDEX | index_pos;
+		}
+		else
+		{
+			entry[0] = px[0];
+			entry[1] = px[1];
+			entry[2] = px[2];
+			entry[3] = px[3];
+
+			if (px[3] == px_prev[3])
+			{
+				signed char vr = px[0] - px_prev[0];
+				signed char vg = px[1] - px_prev[1];
+				signed char vb = px[2] - px_prev[2];
+				signed char vg_r = vr - vg;
+				signed char vg_b = vb - vg;
+
+				if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+				{
+					bytes[p++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+				}
+				else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+				{
+					bytes[p++] = QOI_OP_LUMA | (vg + 32);
+					bytes[p++] = (vg_r + 8) << 4 | (vg_b + 8);
+				}
+				else
+				{
+					bytes[p++] = QOI_OP_RGB;
+					bytes[p++] = px[0];
+					bytes[p++] = px[1];
+					bytes[p++] = px[2];
+				}
+			}
+			else
+			{
+				bytes[p++] = QOI_OP_RGBA;
+				bytes[p++] = px[0];
+				bytes[p++] = px[1];
+				bytes[p++] = px[2];
+				bytes[p++] = px[3];
+			}
+		}
+
+		px_prev[0] = px[0];
+		px_prev[1] = px[1];
+		px_prev[2] = px[2];
+		px_prev[3] = px[3];
+	}
+
+	for (int i = 0; i < QOI_PADDING_SIZE - 1; i++)
+		bytes[p++] = 0;
+
+	bytes[p++] = 1;
+
+	*out_length = p;
+
+	return bytes;
+}
+
+#endif
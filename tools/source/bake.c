@@ -0,0 +1,84 @@
+/***************
+/* bake
+***************/
+
+// decoded image with its full mip chain as a .tex - the engine uploads it as is
+
+int baked_count;
+
+void bake_texture(const string path)
+{
+    int width, height, comp, length;
+    uint qoi_width, qoi_height;
+    char target[MAX_PATH];
+    char source[MAX_PATH];
+    byte* pixels;
+
+    if (strstr(path, ".qoi") != NULL)
+    {
+        // made by tools qoi - both would write the same .tex, the png is the original
+        change_extension(path, ".png", source);
+
+        if (GetFileAttributesA(source) != INVALID_FILE_ATTRIBUTES)
+        {
+            printf("%s: skipped, baked from %s\n", path, source);
+            return;
+        }
+
+        byte* data = read_file(path, &length);
+        pixels = qoi_decode(data, length, &qoi_width, &qoi_height);
+        width = qoi_width;
+        height = qoi_height;
+        free(data);
+    }
+    else
+        pixels = stbi_load(path, &width, &height, &comp, STBI_rgb_alpha);
+
+    if (pixels == NULL)
+    {
+        printf("%s: failed to decode\n", path);
+        return;
+    }
+
+    TexHeader header;
+    header.magic = TEX_MAGIC;
+    header.version = TEX_VERSION;
+    header.width = width;
+    header.height = height;
+    header.levels = tex_mip_count(width, height);
+    header.premultiplied = 0;
+
+    long size = tex_size(width, height, header.levels);
+    byte* chain = (byte*)malloc(size);
+
+    memcpy(chain, pixels, width * height * 4);
+    tex_generate_mips(chain, width, height, header.levels);
+
+    change_extension(path, ".tex", target);
+
+    FILE* file = fopen(target, "wb");
+
+    if (file != NULL)
+    {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(chain, size, 1, file);
+        fclose(file);
+
+        printf("%s -> %s (%i levels, %li bytes)\n", path, target, header.levels, size);
+        baked_count++;
+    }
+    else
+        printf("%s: failed to write %s\n", path, target);
+
+    free(chain);
+    free(pixels);
+}
+
+int bake_textures(const string folder)
+{
+    baked_count = 0;
+    for_each_file(folder, "*.png", bake_texture);
+    for_each_file(folder, "*.qoi", bake_texture);
+
+    return baked_count;
+}
@@ -0,0 +1,157 @@
+//**************************************************
+// Proto Tools - offline asset processing
+// Run from the game build folder, ex:
+//   ..\..\tools\build\tools.exe qoi res
+//**************************************************
+
+#define WIN32_LEAN_AND_MEAN
+#include "external/stb_image.h"
+#include "external/qoi.h"
+#include "external/tex.h"
+#include "external/map.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <windows.h>
+
+typedef char* string;
+typedef unsigned char byte;
+typedef unsigned int uint;
+
+typedef void (*FileCallback)(const string path);
+
+//**************************************************
+// FUNCTIONS
+//**************************************************
+
+byte* read_file(const string filename, int* length)
+{
+    FILE* file = fopen(filename, "rb");
+
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+
+    byte* result = (byte*)malloc(*length);
+    fread(result, 1, *length, file);
+    fclose(file);
+
+    return result;
+}
+
+bool write_file(const string filename, const void* data, const int length)
+{
+    FILE* file = fopen(filename, "wb");
+
+    if (file == NULL)
+        return false;
+
+    fwrite(data, 1, length, file);
+    fclose(file);
+
+    return true;
+}
+
+// same path with a different extension
+void change_extension(const string filename, const string extension, char* result)
+{
+    strcpy(result, filename);
+
+    char* dot = strrchr(result, '.');
+
+    if (dot != NULL)
+        *dot = 0;
+
+    strcat(result, extension);
+}
+
+double now_ms()
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
+// calls back for every file in folder matching pattern (ex: *.png)
+int for_each_file(const string folder, const string pattern, FileCallback callback)
+{
+    char search[MAX_PATH];
+    char path[MAX_PATH];
+    WIN32_FIND_DATAA data;
+    int count = 0;
+
+    sprintf(search, "%s/%s", folder, pattern);
+
+    HANDLE find = FindFirstFileA(search, &data);
+
+    if (find == INVALID_HANDLE_VALUE)
+        return 0;
+
+    do
+    {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        sprintf(path, "%s/%s", folder, data.cFileName);
+        callback(path);
+        count++;
+    }
+    while (FindNextFileA(find, &data));
+
+    FindClose(find);
+
+    return count;
+}
+
+#include "qoi.c"
+#include "bake.c"
+#include "map.c"
+
+//**************************************************
+// MAIN
+//**************************************************
+
+void usage()
+{
+    printf("usage: tools <command> <folder>\n\n");
+    printf("  qoi <folder>      write a .qoi next to every .png\n");
+    printf("  bench <folder>    compare png and qoi decode times\n");
+    printf("  bake <folder>     write a .tex with every mip level next to every .png and lone .qoi\n");
+    printf("  map <folder>      write a .map next to every Tiled .tmx and .json\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    string command = argv[1];
+    string folder = argv[2];
+
+    if (strcmp(command, "qoi") == 0)
+        printf("%i files converted\n", for_each_file(folder, "*.png", convert_qoi));
+    else if (strcmp(command, "bench") == 0)
+        bench_images(folder);
+    else if (strcmp(command, "bake") == 0)
+        printf("%i files baked\n", bake_textures(folder));
+    else if (strcmp(command, "map") == 0)
+        printf("%i maps converted\n", convert_maps(folder));
+    else
+    {
+        usage();
+        return 1;
+    }
+
+    return 0;
+}
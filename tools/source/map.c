@@ -0,0 +1,625 @@
+/***************
+/* map
+***************/
+
+// Tiled maps (.tmx with csv data or .json) as .map files for load_chunk_map
+// only the first tileset is kept - its image becomes the atlas
+// flip flags are dropped and infinite maps aren't supported
+
+#define TILED_FLAGS 0xE0000000 // flip bits on top of Tiled gids
+
+typedef struct TiledMap
+{
+    MapHeader header;
+    MapLayer layers[MAP_MAX_LAYERS];
+    unsigned short* tiles[MAP_MAX_LAYERS];
+    uint first_gid;
+    uint dropped; // tiles from other tilesets
+} TiledMap;
+
+char* read_text(const string filename)
+{
+    int length;
+    byte* data = read_file(filename, &length);
+
+    if (data == NULL)
+        return NULL;
+
+    data = (byte*)realloc(data, length + 1);
+    data[length] = 0;
+
+    return (char*)data;
+}
+
+// folder of path with its separator - empty for none
+void folder_of(const string path, char* result)
+{
+    strcpy(result, path);
+
+    char* slash = strrchr(result, '/');
+    char* backslash = strrchr(result, '\\');
+
+    if (backslash > slash)
+        slash = backslash;
+
+    if (slash != NULL)
+        slash[1] = 0;
+    else
+        result[0] = 0;
+}
+
+// the layer tile for a Tiled gid
+unsigned short map_tile(TiledMap* map, uint gid)
+{
+    gid &= ~TILED_FLAGS;
+
+    if (gid == 0)
+        return 0;
+
+    if (gid < map->first_gid || gid - map->first_gid + 1 > 0xFFFF)
+    {
+        map->dropped++;
+        return 0;
+    }
+
+    return gid - map->first_gid + 1;
+}
+
+// room for one more layer - false when full
+bool add_layer(TiledMap* map, const string path, const char* name, const float opacity, const bool visible)
+{
+    if (map->header.layers >= MAP_MAX_LAYERS)
+    {
+        printf("%s: layer %s skipped - %i layers at most\n", path, name, MAP_MAX_LAYERS);
+        return false;
+    }
+
+    MapLayer* layer = &map->layers[map->header.layers];
+    long count = (long)map->header.columns * map->header.rows;
+
+    memset(layer, 0, sizeof(MapLayer));
+    strncpy(layer->name, name, MAP_NAME_LENGTH - 1);
+    layer->opacity = (uint)(opacity * 255.f + 0.5f);
+    layer->visible = visible;
+
+    map->tiles[map->header.layers] = (unsigned short*)calloc(count, sizeof(unsigned short));
+    map->header.layers++;
+
+    return true;
+}
+
+bool write_map(const string path, TiledMap* map)
+{
+    char target[MAX_PATH];
+    long count = (long)map->header.columns * map->header.rows;
+
+    change_extension(path, ".map", target);
+
+    FILE* file = fopen(target, "wb");
+
+    if (file == NULL)
+    {
+        printf("%s: failed to write %s\n", path, target);
+        return false;
+    }
+
+    fwrite(&map->header, sizeof(MapHeader), 1, file);
+
+    for (uint i = 0; i < map->header.layers; i++)
+    {
+        fwrite(&map->layers[i], sizeof(MapLayer), 1, file);
+        fwrite(map->tiles[i], sizeof(unsigned short), count, file);
+    }
+
+    fclose(file);
+
+    printf("%s -> %s (%ix%i, %i layers, atlas %s, %li bytes)\n", path, target,
+        map->header.columns, map->header.rows, map->header.layers, map->header.atlas, map_size(&map->header));
+
+    if (map->dropped > 0)
+        printf("%s: %i tiles from other tilesets dropped\n", path, map->dropped);
+
+    return true;
+}
+
+void free_map(TiledMap* map)
+{
+    for (uint i = 0; i < map->header.layers; i++)
+        free(map->tiles[i]);
+}
+
+void begin_map(TiledMap* map, const uint columns, const uint rows, const uint tile_width, const uint tile_height)
+{
+    memset(map, 0, sizeof(TiledMap));
+    map->header.magic = MAP_MAGIC;
+    map->header.version = MAP_VERSION;
+    map->header.columns = columns;
+    map->header.rows = rows;
+    map->header.tile_width = tile_width;
+    map->header.tile_height = tile_height;
+}
+
+// atlas path from the game build folder - the image is relative to the map
+bool set_atlas(TiledMap* map, const string path, const char* image)
+{
+    char atlas[MAX_PATH];
+
+    folder_of(path, atlas);
+    strcat(atlas, image);
+
+    if (strlen(atlas) >= MAP_ATLAS_LENGTH)
+    {
+        printf("%s: atlas path %s longer than %i\n", path, atlas, MAP_ATLAS_LENGTH - 1);
+        return false;
+    }
+
+    strcpy(map->header.atlas, atlas);
+
+    return true;
+}
+
+//**************************************************
+// TMX
+//**************************************************
+
+// next <name ...> tag from text - NULL when there's none
+const char* xml_tag(const char* text, const char* name)
+{
+    int length = strlen(name);
+
+    while ((text = strchr(text, '<')) != NULL)
+    {
+        text++;
+
+        if (strncmp(text, name, length) == 0 && (text[length] == ' ' || text[length] == '>' || text[length] == '/'))
+            return text;
+    }
+
+    return NULL;
+}
+
+// value of an attribute of the tag - false when the tag doesn't have it
+bool xml_attribute(const char* tag, const char* name, char* result, const int size)
+{
+    const char* end = strchr(tag, '>');
+    int length = strlen(name);
+
+    for (const char* p = tag; p != NULL && p < end; p = strchr(p + 1, ' '))
+    {
+        if (strncmp(p + 1, name, length) != 0 || p[length + 1] != '=' || p[length + 2] != '"')
+            continue;
+
+        const char* value = p + length + 3;
+        const char* quote = strchr(value, '"');
+        int value_length = quote - value < size - 1 ? quote - value : size - 1;
+
+        memcpy(result, value, value_length);
+        result[value_length] = 0;
+
+        return true;
+    }
+
+    return false;
+}
+
+uint xml_uint(const char* tag, const char* name, const uint otherwise)
+{
+    char value[32];
+
+    return xml_attribute(tag, name, value, sizeof(value)) ? strtoul(value, NULL, 10) : otherwise;
+}
+
+// image of the tileset - embedded or in a .tsx next to the map
+bool tmx_tileset(TiledMap* map, const string path, const char* tileset)
+{
+    char source[MAX_PATH];
+    char image[MAX_PATH];
+
+    map->first_gid = xml_uint(tileset, "firstgid", 1);
+
+    if (xml_attribute(tileset, "source", source, sizeof(source)))
+    {
+        char tsx_path[MAX_PATH];
+        folder_of(path, tsx_path);
+        strcat(tsx_path, source);
+
+        char* tsx = read_text(tsx_path);
+        const char* tag = tsx != NULL ? xml_tag(tsx, "image") : NULL;
+        bool found = tag != NULL && xml_attribute(tag, "source", image, sizeof(image));
+
+        free(tsx);
+
+        if (! found)
+        {
+            printf("%s: no image in tileset %s\n", path, tsx_path);
+            return false;
+        }
+
+        // relative to the tsx - that is relative to the map
+        char relative[MAX_PATH];
+        folder_of(source, relative);
+        strcat(relative, image);
+
+        return set_atlas(map, path, relative);
+    }
+
+    const char* tag = xml_tag(tileset, "image");
+
+    if (tag == NULL || ! xml_attribute(tag, "source", image, sizeof(image)))
+    {
+        printf("%s: first tileset has no image\n", path);
+        return false;
+    }
+
+    return set_atlas(map, path, image);
+}
+
+bool convert_tmx(const string path, TiledMap* map, const char* text)
+{
+    const char* tag = xml_tag(text, "map");
+
+    if (tag == NULL)
+    {
+        printf("%s: no map\n", path);
+        return false;
+    }
+
+    if (xml_uint(tag, "infinite", 0) != 0)
+    {
+        printf("%s: infinite maps aren't supported\n", path);
+        return false;
+    }
+
+    begin_map(map, xml_uint(tag, "width", 0), xml_uint(tag, "height", 0),
+        xml_uint(tag, "tilewidth", 0), xml_uint(tag, "tileheight", 0));
+
+    const char* tileset = xml_tag(tag, "tileset");
+
+    if (tileset == NULL || ! tmx_tileset(map, path, tileset))
+        return false;
+
+    for (const char* layer = xml_tag(tag, "layer"); layer != NULL; layer = xml_tag(layer, "layer"))
+    {
+        char name[MAP_NAME_LENGTH];
+        char opacity[32];
+        char encoding[32];
+
+        if (! xml_attribute(layer, "name", name, sizeof(name)))
+            strcpy(name, "layer");
+
+        if (! xml_attribute(layer, "opacity", opacity, sizeof(opacity)))
+            strcpy(opacity, "1");
+
+        const char* data = xml_tag(layer, "data");
+
+        if (data == NULL || ! xml_attribute(data, "encoding", encoding, sizeof(encoding)) || strcmp(encoding, "csv") != 0)
+        {
+            printf("%s: layer %s skipped - only csv data is supported\n", path, name);
+            continue;
+        }
+
+        if (! add_layer(map, path, name, (float)strtod(opacity, NULL), xml_uint(layer, "visible", 1) != 0))
+            break;
+
+        unsigned short* tiles = map->tiles[map->header.layers - 1];
+        long count = (long)map->header.columns * map->header.rows;
+        const char* p = strchr(data, '>') + 1;
+        const char* end = strstr(p, "</data>");
+
+        for (long i = 0; i < count && p < end; i++)
+        {
+            char* next;
+            uint gid = strtoul(p, &next, 10);
+
+            if (next == p)
+                break;
+
+            tiles[i] = map_tile(map, gid);
+            p = next;
+
+            while (*p == ',' || *p == ' ' || *p == '\r' || *p == '\n')
+                p++;
+        }
+    }
+
+    return true;
+}
+
+//**************************************************
+// JSON
+//**************************************************
+
+// just enough json walking for Tiled maps
+
+const char* json_space(const char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+
+    return p;
+}
+
+// past the value starting at p
+const char* json_skip(const char* p)
+{
+    p = json_space(p);
+
+    if (*p == '"')
+    {
+        for (p++; *p != 0 && *p != '"'; p++)
+            if (*p == '\\' && p[1] != 0)
+                p++;
+
+        return *p == '"' ? p + 1 : p;
+    }
+
+    if (*p == '{' || *p == '[')
+    {
+        int depth = 0;
+
+        while (*p != 0)
+        {
+            if (*p == '"')
+            {
+                p = json_skip(p);
+                continue;
+            }
+
+            if (*p == '{' || *p == '[')
+                depth++;
+            else if (*p == '}' || *p == ']')
+            {
+                depth--;
+
+                if (depth == 0)
+                    return p + 1;
+            }
+
+            p++;
+        }
+
+        return p;
+    }
+
+    while (*p != 0 && *p != ',' && *p != '}' && *p != ']')
+        p++;
+
+    return p;
+}
+
+// value of a key of the object at p - NULL when it has none
+const char* json_value(const char* p, const char* key)
+{
+    int length = strlen(key);
+
+    p = json_space(p);
+
+    if (*p != '{')
+        return NULL;
+
+    p = json_space(p + 1);
+
+    while (*p == '"')
+    {
+        bool match = strncmp(p + 1, key, length) == 0 && p[length + 1] == '"';
+
+        p = json_space(json_skip(p));
+
+        if (*p != ':')
+            return NULL;
+
+        p = json_space(p + 1);
+
+        if (match)
+            return p;
+
+        p = json_space(json_skip(p));
+
+        if (*p == ',')
+            p = json_space(p + 1);
+    }
+
+    return NULL;
+}
+
+double json_number(const char* object, const char* key, const double otherwise)
+{
+    const char* value = json_value(object, key);
+
+    if (value == NULL)
+        return otherwise;
+
+    if (strncmp(value, "true", 4) == 0)
+        return 1;
+
+    if (strncmp(value, "false", 5) == 0)
+        return 0;
+
+    return strtod(value, NULL);
+}
+
+bool json_string(const char* object, const char* key, char* result, const int size)
+{
+    const char* value = json_value(object, key);
+
+    if (value == NULL || *value != '"')
+        return false;
+
+    value++;
+
+    int length = 0;
+
+    for (; *value != 0 && *value != '"' && length < size - 1; value++)
+    {
+        if (*value == '\\' && value[1] != 0)
+            value++;
+
+        result[length++] = *value;
+    }
+
+    result[length] = 0;
+
+    return true;
+}
+
+// first element of the array at p - NULL for none
+const char* json_first(const char* p)
+{
+    p = json_space(p);
+
+    if (*p != '[')
+        return NULL;
+
+    p = json_space(p + 1);
+
+    return *p == ']' ? NULL : p;
+}
+
+// element after the one at p - NULL at the end
+const char* json_next(const char* p)
+{
+    p = json_space(json_skip(p));
+
+    return *p == ',' ? json_space(p + 1) : NULL;
+}
+
+// image of the tileset - embedded or in a .tsx or .json next to the map
+bool json_tileset(TiledMap* map, const string path, const char* tileset)
+{
+    char source[MAX_PATH];
+    char image[MAX_PATH];
+
+    map->first_gid = (uint)json_number(tileset, "firstgid", 1);
+
+    if (! json_string(tileset, "source", source, sizeof(source)))
+    {
+        if (! json_string(tileset, "image", image, sizeof(image)))
+        {
+            printf("%s: first tileset has no image\n", path);
+            return false;
+        }
+
+        return set_atlas(map, path, image);
+    }
+
+    char tileset_path[MAX_PATH];
+    folder_of(path, tileset_path);
+    strcat(tileset_path, source);
+
+    char* text = read_text(tileset_path);
+    bool found = false;
+
+    if (text != NULL && strstr(source, ".json") != NULL)
+        found = json_string(text, "image", image, sizeof(image));
+    else if (text != NULL)
+    {
+        const char* tag = xml_tag(text, "image");
+        found = tag != NULL && xml_attribute(tag, "source", image, sizeof(image));
+    }
+
+    free(text);
+
+    if (! found)
+    {
+        printf("%s: no image in tileset %s\n", path, tileset_path);
+        return false;
+    }
+
+    // relative to the tileset - that is relative to the map
+    char relative[MAX_PATH];
+    folder_of(source, relative);
+    strcat(relative, image);
+
+    return set_atlas(map, path, relative);
+}
+
+bool convert_json(const string path, TiledMap* map, const char* text)
+{
+    if (json_number(text, "infinite", 0) != 0)
+    {
+        printf("%s: infinite maps aren't supported\n", path);
+        return false;
+    }
+
+    begin_map(map, (uint)json_number(text, "width", 0), (uint)json_number(text, "height", 0),
+        (uint)json_number(text, "tilewidth", 0), (uint)json_number(text, "tileheight", 0));
+
+    const char* tilesets = json_value(text, "tilesets");
+    const char* tileset = tilesets != NULL ? json_first(tilesets) : NULL;
+
+    if (tileset == NULL || ! json_tileset(map, path, tileset))
+        return false;
+
+    const char* layers = json_value(text, "layers");
+
+    for (const char* layer = layers != NULL ? json_first(layers) : NULL; layer != NULL; layer = json_next(layer))
+    {
+        char name[MAP_NAME_LENGTH];
+        char type[32];
+
+        if (! json_string(layer, "name", name, sizeof(name)))
+            strcpy(name, "layer");
+
+        // object, image and group layers
+        if (! json_string(layer, "type", type, sizeof(type)) || strcmp(type, "tilelayer") != 0)
+            continue;
+
+        const char* data = json_value(layer, "data");
+
+        if (data == NULL || *data != '[')
+        {
+            printf("%s: layer %s skipped - only csv data is supported\n", path, name);
+            continue;
+        }
+
+        if (! add_layer(map, path, name, json_number(layer, "opacity", 1), json_number(layer, "visible", 1) != 0))
+            break;
+
+        unsigned short* tiles = map->tiles[map->header.layers - 1];
+        long count = (long)map->header.columns * map->header.rows;
+        long i = 0;
+
+        for (const char* tile = json_first(data); tile != NULL && i < count; tile = json_next(tile))
+            tiles[i++] = map_tile(map, strtoul(tile, NULL, 10));
+    }
+
+    return true;
+}
+
+//**************************************************
+// CONVERT
+//**************************************************
+
+void convert_map(const string path)
+{
+    TiledMap map;
+    char* text = read_text(path);
+
+    if (text == NULL)
+    {
+        printf("%s: failed to read\n", path);
+        return;
+    }
+
+    bool json = strstr(path, ".json") != NULL;
+
+    memset(&map, 0, sizeof(map));
+
+    if ((json ? convert_json(path, &map, text) : convert_tmx(path, &map, text)))
+    {
+        if (map.header.columns == 0 || map.header.rows == 0 || map.header.tile_width == 0 || map.header.layers == 0)
+            printf("%s: no tile layers\n", path);
+        else
+            write_map(path, &map);
+    }
+
+    free_map(&map);
+    free(text);
+}
+
+int convert_maps(const string folder)
+{
+    return
+        for_each_file(folder, "*.tmx", convert_map) +
+        for_each_file(folder, "*.json", convert_map);
+}
@@ -0,0 +1,90 @@
+/***************
+/* qoi
+***************/
+
+const int BENCH_ITERATIONS = 20;
+
+double bench_png_ms;
+double bench_qoi_ms;
+long bench_png_bytes;
+long bench_qoi_bytes;
+
+void convert_qoi(const string path)
+{
+    int width, height, comp, length;
+    char target[MAX_PATH];
+
+    byte* pixels = stbi_load(path, &width, &height, &comp, STBI_rgb_alpha);
+
+    if (pixels == NULL)
+    {
+        printf("%s: %s\n", path, stbi_failure_reason());
+        return;
+    }
+
+    void* data = qoi_encode(pixels, width, height, &length);
+    change_extension(path, ".qoi", target);
+
+    if (data != NULL && write_file(target, data, length))
+        printf("%s -> %s (%i bytes)\n", path, target, length);
+    else
+        printf("%s: failed to write %s\n", path, target);
+
+    free(data);
+    stbi_image_free(pixels);
+}
+
+void bench_image(const string path)
+{
+    int png_length, qoi_length, width, height, comp;
+    uint qoi_width, qoi_height;
+
+    byte* png = read_file(path, &png_length);
+    byte* pixels = stbi_load_from_memory(png, png_length, &width, &height, &comp, STBI_rgb_alpha);
+
+    if (pixels == NULL)
+    {
+        free(png);
+        return;
+    }
+
+    void* qoi = qoi_encode(pixels, width, height, &qoi_length);
+    stbi_image_free(pixels);
+
+    double start = now_ms();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        stbi_image_free(stbi_load_from_memory(png, png_length, &width, &height, &comp, STBI_rgb_alpha));
+
+    double png_ms = (now_ms() - start) / BENCH_ITERATIONS;
+
+    start = now_ms();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        free(qoi_decode(qoi, qoi_length, &qoi_width, &qoi_height));
+
+    double qoi_ms = (now_ms() - start) / BENCH_ITERATIONS;
+
+    printf("%-32s %4ix%-4i png %7i bytes %7.3f ms | qoi %7i bytes %7.3f ms | x%.1f\n",
+        path, width, height, png_length, png_ms, qoi_length, qoi_ms, png_ms / qoi_ms);
+
+    bench_png_ms += png_ms;
+    bench_qoi_ms += qoi_ms;
+    bench_png_bytes += png_length;
+    bench_qoi_bytes += qoi_length;
+
+    free(qoi);
+    free(png);
+}
+
+void bench_images(const string folder)
+{
+    bench_png_ms = bench_qoi_ms = 0;
+    bench_png_bytes = bench_qoi_bytes = 0;
+
+    int count = for_each_file(folder, "*.png", bench_image);
+
+    printf("\n%i images - png %li bytes %.3f ms | qoi %li bytes %.3f ms | x%.1f faster\n",
+        count, bench_png_bytes, bench_png_ms, bench_qoi_bytes, bench_qoi_ms,
+        bench_qoi_ms > 0 ? bench_png_ms / bench_qoi_ms : 0);
+}